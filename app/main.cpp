@@ -7,6 +7,9 @@
 #include "../gui/widgets/graph_plotter.hpp"
 #include "../gui/widgets/oscilloscope.hpp"
 #include "../gui/widgets/sf_view.hpp"
+#include "../gui/widgets/spectrogram.hpp"
+#include "../gui/widgets/bus_meters.hpp"
+#include "../gui/widgets/bus_binding.hpp"
 #include "../gui/utility/array_layout.hpp"
 #include "../gui/utility/mapping.hpp"
 
@@ -61,6 +64,12 @@ int main(int argc, char *argv[])
             ("QuickCollider", 0, 1, "OscilloscopePlotter");
     qmlRegisterType<QuickCollider::SoundFileView>
             ("QuickCollider", 0, 1, "WaveformPlotter");
+    qmlRegisterType<QuickCollider::Spectrogram>
+            ("QuickCollider", 0, 1, "SpectrogramPlotter");
+    qmlRegisterType<QuickCollider::ControlBusMeters>
+            ("QuickCollider", 0, 1, "ControlBusMetersPlotter");
+    qmlRegisterType<QuickCollider::ControlBusBinding>
+            ("QuickCollider", 0, 1, "ControlBusBinding");
 
     OscServer *oscServer;
     try {
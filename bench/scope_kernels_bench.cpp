@@ -0,0 +1,144 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Measures the scope vertex, trigger and statistics kernels for every instruction set
+// supported by this CPU, over typical channel and frame counts.
+//
+// Usage: scope_kernels_bench [pixel width]
+
+#include "../gui/widgets/scope_kernels.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace QuickCollider;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Keeps the compiler from optimizing away the work.
+volatile float g_sink;
+
+template <typename Work>
+double nanosecondsPerFrame( Work work, int frames_per_pass )
+{
+    // Repeat until at least ~20 ms have passed, for stable numbers.
+    long long passes = 0;
+    Clock::duration elapsed(0);
+    Clock::time_point start = Clock::now();
+    do {
+        work();
+        ++passes;
+        elapsed = Clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(20));
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    return ns / (passes * (double) frames_per_pass);
+}
+
+} // namespace
+
+int main( int argc, char *argv[] )
+{
+    int width = argc > 1 ? std::atoi(argv[1]) : 512;
+    if (width < 1) {
+        std::fprintf(stderr, "Invalid pixel width.\n");
+        return 1;
+    }
+
+    const int channel_counts[] = { 1, 2, 8, 32, 64 };
+    const int frame_counts[] = { 256, 1024, 4096, 16384 };
+    const InstructionSet isas[] = { ScalarInstructions, Sse2Instructions, Avx2Instructions };
+
+    std::printf("# ns per frame; min-max reduces to %d columns\n", width);
+    std::printf("%-8s %8s %8s %10s %10s %10s %10s %10s\n",
+                "isa", "channels", "frames", "indexed", "xy", "min-max", "trigger", "sums");
+
+    for (int isa_idx = 0; isa_idx < 3; ++isa_idx)
+    {
+        const ScopeKernels *kernels = ScopeKernels::get(isas[isa_idx]);
+        if (!kernels)
+            continue;
+
+        for (int frames : frame_counts)
+        {
+            for (int channels : channel_counts)
+            {
+                int samples = channels * frames;
+                std::vector<float> data(samples);
+                for (int idx = 0; idx < samples; ++idx)
+                    data[idx] = std::sin(idx * 0.01f) + (std::rand() % 100) * 0.001f;
+                std::vector<float> vertices(samples * 4);
+
+                int columns = std::min(width, frames);
+
+                double indexed = nanosecondsPerFrame( [&]() {
+                    for (int ch = 0; ch < channels; ++ch)
+                        kernels->indexedVertices( &data[ch * frames], &vertices[ch * frames * 2], frames );
+                    g_sink = vertices[1];
+                }, samples );
+
+                double xy = nanosecondsPerFrame( [&]() {
+                    for (int ch = 0; ch + 1 < channels || ch == 0; ch += 2) {
+                        const float *x = &data[ch * frames];
+                        const float *y = channels > 1 ? x + frames : x;
+                        kernels->xyVertices( x, y, &vertices[ch * frames * 2], frames );
+                    }
+                    g_sink = vertices[1];
+                }, samples );
+
+                double min_max = nanosecondsPerFrame( [&]() {
+                    for (int ch = 0; ch < channels; ++ch)
+                        kernels->minMaxVertices( &data[ch * frames], frames, columns,
+                                                 &vertices[ch * columns * 4] );
+                    g_sink = vertices[1];
+                }, samples );
+
+                // A level that is never reached makes the search scan everything.
+                double trigger = nanosecondsPerFrame( [&]() {
+                    int found = 0;
+                    for (int ch = 0; ch < channels; ++ch) {
+                        bool armed = false;
+                        found += kernels->findTrigger( &data[ch * frames], frames,
+                                                       10.f, 0.1f, true, armed );
+                    }
+                    g_sink = found;
+                }, samples );
+
+                double sums = nanosecondsPerFrame( [&]() {
+                    ScopeSums result;
+                    double total = 0.0;
+                    for (int ch = 0; ch < channels; ++ch) {
+                        kernels->sums( &data[ch * frames], frames, result );
+                        total += result.sum_of_squares;
+                    }
+                    g_sink = total;
+                }, samples );
+
+                std::printf("%-8s %8d %8d %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                            instructionSetName(kernels->isa), channels, frames,
+                            indexed, xy, min_max, trigger, sums);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Measures the Oscilloscope render path against a local ScopeSignalProducer,
+// over typical channel and frame counts: the time the render thread spends
+// synchronizing the scene graph (pulling the latest frame and running
+// updatePaintNode), and the interval between presented frames.
+//
+// Usage: scope_render_bench [port] [seconds per configuration]
+//
+// The port must not be used by a running server.
+
+#include "../gui/widgets/oscilloscope.hpp"
+#include "../tools/scope_signal_producer.hpp"
+
+#include <QGuiApplication>
+#include <QQuickView>
+#include <QQuickItem>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QMutex>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <thread>
+
+using namespace QuickCollider;
+
+namespace {
+
+// Timings in milliseconds, collected on the render thread.
+struct RenderTimes
+{
+    RenderTimes() { reset(); }
+
+    void reset()
+    {
+        QMutexLocker locker(&mutex);
+        sync_total = sync_max = 0.0;
+        syncs = 0;
+        frame_total = frame_max = 0.0;
+        frames = 0;
+        last_swap = -1.0;
+    }
+
+    QMutex mutex;
+    QElapsedTimer clock;
+    double sync_start;
+    double sync_total;
+    double sync_max;
+    int syncs;
+    double frame_total;
+    double frame_max;
+    int frames;
+    double last_swap;
+};
+
+double now( const QElapsedTimer & clock )
+{
+    return clock.nsecsElapsed() * 1e-6;
+}
+
+} // namespace
+
+int main( int argc, char *argv[] )
+{
+    QGuiApplication app(argc, argv);
+
+    int port = argc > 1 ? std::atoi(argv[1]) : 57199;
+    int seconds = argc > 2 ? std::atoi(argv[2]) : 2;
+    if (port < 1 || seconds < 1) {
+        std::fprintf(stderr, "Usage: scope_render_bench [port] [seconds per configuration]\n");
+        return 1;
+    }
+
+    QQuickView view;
+    view.resize(1024, 600);
+
+    Oscilloscope *scope = new Oscilloscope(view.contentItem());
+    scope->setWidth(1024);
+    scope->setHeight(600);
+    scope->setServerPort(port);
+    scope->setBufferNumber(0);
+    scope->setUpdateInterval(5);
+
+    RenderTimes times;
+    times.clock.start();
+
+    QObject::connect(&view, &QQuickWindow::beforeSynchronizing, &view, [&]() {
+        times.sync_start = now(times.clock);
+    }, Qt::DirectConnection);
+
+    QObject::connect(&view, &QQuickWindow::afterSynchronizing, &view, [&]() {
+        double duration = now(times.clock) - times.sync_start;
+        QMutexLocker locker(&times.mutex);
+        times.sync_total += duration;
+        times.sync_max = std::max(times.sync_max, duration);
+        ++times.syncs;
+    }, Qt::DirectConnection);
+
+    QObject::connect(&view, &QQuickWindow::frameSwapped, &view, [&]() {
+        double swap = now(times.clock);
+        QMutexLocker locker(&times.mutex);
+        if (times.last_swap >= 0.0) {
+            double interval = swap - times.last_swap;
+            times.frame_total += interval;
+            times.frame_max = std::max(times.frame_max, interval);
+            ++times.frames;
+        }
+        times.last_swap = swap;
+    }, Qt::DirectConnection);
+
+    view.show();
+
+    const int channel_counts[] = { 1, 2, 8, 32 };
+    const int frame_counts[] = { 256, 1024, 4096, 16384 };
+    const float sample_rate = 48000.f;
+
+    std::printf("# times in ms; sync includes updatePaintNode\n");
+    std::printf("%8s %8s %8s %10s %10s %10s %10s\n",
+                "channels", "frames", "renders", "sync avg", "sync max", "frame avg", "frame max");
+
+    for (int frames : frame_counts)
+    {
+        for (int channels : channel_counts)
+        {
+            // The previous producer removed its segment when deleted.
+            ScopeSignalProducer *producer;
+            try {
+                producer = new ScopeSignalProducer( port, 16384, sample_rate );
+            }
+            catch (std::exception & e) {
+                std::fprintf(stderr, "Could not create shared memory for port %d: %s\n"
+                             "Use a port no server is running on.\n",
+                             port, e.what());
+                return 1;
+            }
+
+            if (!producer->addScopeBuffer( 0, channels, frames )) {
+                std::fprintf(stderr, "Could not allocate scope buffer.\n");
+                delete producer;
+                return 1;
+            }
+
+            // Push one full buffer at a time, in real time.
+            std::atomic<bool> quit(false);
+            std::thread writer([&]() {
+                typedef std::chrono::steady_clock Clock;
+                Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+                            std::chrono::duration<double>(frames / sample_rate));
+                Clock::time_point next = Clock::now();
+                while (!quit) {
+                    producer->write( frames );
+                    next += period;
+                    std::this_thread::sleep_until(next);
+                }
+            });
+
+            scope->start();
+
+            // Let the first frames settle before measuring.
+            QEventLoop loop;
+            QTimer::singleShot(200, &loop, SLOT(quit()));
+            loop.exec();
+
+            times.reset();
+
+            QTimer::singleShot(seconds * 1000, &loop, SLOT(quit()));
+            loop.exec();
+
+            scope->stop();
+
+            quit = true;
+            writer.join();
+            delete producer;
+
+            QMutexLocker locker(&times.mutex);
+            std::printf("%8d %8d %8d %10.3f %10.3f %10.3f %10.3f\n",
+                        channels, frames, times.syncs,
+                        times.syncs ? times.sync_total / times.syncs : 0.0, times.sync_max,
+                        times.frames ? times.frame_total / times.frames : 0.0, times.frame_max);
+            std::fflush(stdout);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Measures the sound file view kernels for every instruction set supported by
+// this CPU: reducing samples to cache units at several resolutions, and
+// reducing samples and cache units for display.
+//
+// Usage: sound_kernels_bench [frames]
+
+#include "../gui/widgets/sf_kernels.hpp"
+
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace QuickCollider;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Keeps the compiler from optimizing away the work.
+volatile double g_sink;
+
+template <typename Work>
+double nanosecondsPerItem( Work work, int items_per_pass )
+{
+    // Repeat until at least ~20 ms have passed, for stable numbers.
+    long long passes = 0;
+    Clock::duration elapsed(0);
+    Clock::time_point start = Clock::now();
+    do {
+        work();
+        ++passes;
+        elapsed = Clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(20));
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    return ns / (passes * (double) items_per_pass);
+}
+
+} // namespace
+
+int main( int argc, char *argv[] )
+{
+    int frames = argc > 1 ? std::atoi(argv[1]) : 1 << 20;
+    if (frames < 1) {
+        std::fprintf(stderr, "Invalid frame count.\n");
+        return 1;
+    }
+
+    const int unit_sizes[] = { 1, 4, 16, 64, 256, 1024 };
+    const InstructionSet isas[] = { ScalarInstructions, Sse2Instructions, Avx2Instructions };
+
+    std::vector<short> data(frames);
+    for (int idx = 0; idx < frames; ++idx)
+        data[idx] = std::sin(idx * 0.01f) * 30000 + (std::rand() % 1000);
+
+    std::vector<short> min(frames), max(frames);
+    std::vector<float> sum(frames), sum_sq(frames);
+
+    std::printf("# ns per sample; %d frames\n", frames);
+    std::printf("%-8s %8s %10s %10s %10s\n",
+                "isa", "fpu", "units", "samples", "cache");
+
+    for (int isa_idx = 0; isa_idx < 3; ++isa_idx)
+    {
+        const SoundKernels *kernels = SoundKernels::get(isas[isa_idx]);
+        if (!kernels)
+            continue;
+
+        for (int fpu : unit_sizes)
+        {
+            int units = frames / fpu;
+
+            // Building the cache
+            double unit_time = nanosecondsPerItem( [&]() {
+                kernels->unitSums( &data[0], units, fpu, &min[0], &max[0], &sum[0], &sum_sq[0] );
+                g_sink = sum[0];
+            }, units * fpu );
+
+            // Displaying raw data, one pixel per 'fpu' samples
+            double sample_time = nanosecondsPerItem( [&]() {
+                double total = 0.0;
+                for (int unit = 0; unit < units; ++unit) {
+                    SoundSums sums = { SHRT_MAX, SHRT_MIN, 0.0, 0.0 };
+                    kernels->sampleSums( &data[unit * fpu], fpu, sums );
+                    total += sums.sum_of_squares;
+                }
+                g_sink = total;
+            }, units * fpu );
+
+            // Displaying the cache, one pixel per 'fpu' units
+            double cache_time = nanosecondsPerItem( [&]() {
+                double total = 0.0;
+                for (int unit = 0; unit < units; ++unit) {
+                    SoundSums sums = { SHRT_MAX, SHRT_MIN, 0.0, 0.0 };
+                    int idx = unit * fpu;
+                    kernels->cacheSums( &min[idx], &max[idx], &sum[idx], &sum_sq[idx], fpu, sums );
+                    total += sums.sum_of_squares;
+                }
+                g_sink = total;
+            }, units * fpu );
+
+            std::printf("%-8s %8d %10.3f %10.3f %10.3f\n",
+                        instructionSetName(kernels->isa), fpu,
+                        unit_time, sample_time, cache_time);
+        }
+    }
+
+    return 0;
+}
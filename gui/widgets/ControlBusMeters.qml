@@ -0,0 +1,35 @@
+import QtQuick 2.0
+import QuickCollider 0.1
+
+Item {
+    property alias server: plotter.server // server port
+    property alias firstBus: plotter.firstBus
+    property alias count: plotter.count
+    property alias controlBusCount: plotter.controlBusCount // of the server
+    property alias range: plotter.range // dB
+    property alias peakHoldTime: plotter.peakHoldTime // seconds
+    property alias spacing: plotter.spacing
+    property alias rmsColor: plotter.rmsColor
+    property alias peakColor: plotter.peakColor
+    property alias holdColor: plotter.holdColor
+    property alias running: plotter.running
+    property color borderColor: "black"
+
+    function start() { plotter.start() }
+    function stop() { plotter.stop() }
+
+    Rectangle {
+        id: bkgItem
+        anchors.fill: parent
+        color: "black"
+        border.color: borderColor
+        border.width: 1
+
+        ControlBusMetersPlotter
+        {
+            id: plotter
+            anchors.fill: parent
+            anchors.margins: 1
+        }
+    }
+}
@@ -2,19 +2,40 @@ import QtQuick 2.0
 import QuickCollider 0.1
 
 Item {
+    id: scope
     property alias server: plotter.server // server port
     property alias buffer: plotter.buffer // buffer index
     property alias running: plotter.running
     property alias updateInterval: plotter.updateInterval
     property alias mode: plotter.mode
+    property alias xOffset: plotter.xOffset
+    property alias yOffset: plotter.yOffset
     property alias xZoom: plotter.xZoom
     property alias yZoom: plotter.yZoom
+    property alias triggerMode: plotter.triggerMode
+    property alias triggerSlope: plotter.triggerSlope
+    property alias triggerChannel: plotter.triggerChannel
+    property alias triggerLevel: plotter.triggerLevel
+    property alias triggerHysteresis: plotter.triggerHysteresis
+    property alias triggerHoldoff: plotter.triggerHoldoff // frames
+    property alias triggerArmed: plotter.triggerArmed
+    property alias spectrumBins: plotter.spectrumBins
+    property alias spectrumAveraging: plotter.spectrumAveraging
+    property alias spectrumRange: plotter.spectrumRange // dB
+    property alias persistence: plotter.persistence // seconds
+    property alias statisticsEnabled: plotter.statisticsEnabled
+    property alias statistics: plotter.statistics // per channel: peak, rms, dc, crest, zeroCrossingRate
     property color backgroundColor: Qt.rgba(0.1,0.1,0.1)
     property color borderColor: "black"
     property alias plotColors: plotter.trackColors
 
+    // The statistics of one channel, as numbers that can be sent over OSC
+    signal channelStatisticsChanged(int channel, real peak, real rms, real dc,
+                                    real crest, real zeroCrossingRate)
+
     function start() { plotter.start() }
     function stop() { plotter.stop() }
+    function armTrigger() { plotter.armTrigger() }
 
     Rectangle {
         id: bkgItem
@@ -29,6 +50,8 @@ Item {
             anchors.fill: parent
             anchors.margins: 1
             clip: true
+            onChannelStatisticsChanged: scope.channelStatisticsChanged(channel, peak, rms, dc,
+                                                                       crest, zeroCrossingRate)
         }
     }
 }
@@ -0,0 +1,32 @@
+import QtQuick 2.0
+import QuickCollider 0.1
+
+Item {
+    property alias server: plotter.server // server port
+    property alias buffer: plotter.buffer // buffer index
+    property alias channel: plotter.channel
+    property alias running: plotter.running
+    property alias updateInterval: plotter.updateInterval
+    property alias history: plotter.history // columns
+    property alias bins: plotter.bins
+    property alias range: plotter.range // dB
+    property color borderColor: "black"
+
+    function start() { plotter.start() }
+    function stop() { plotter.stop() }
+
+    Rectangle {
+        id: bkgItem
+        anchors.fill: parent
+        color: "black"
+        border.color: borderColor
+        border.width: 1
+
+        SpectrogramPlotter
+        {
+            id: plotter
+            anchors.fill: parent
+            anchors.margins: 1
+        }
+    }
+}
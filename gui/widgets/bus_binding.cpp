@@ -0,0 +1,230 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bus_binding.hpp"
+#include "shm_client_pool.hpp"
+
+#include <QGuiApplication>
+#include <QScreen>
+#include <QTimerEvent>
+#include <QDebug>
+
+#include <cmath>
+
+namespace QuickCollider {
+
+// Wraps the shm interface, which moc can not process (see oscilloscope.hpp).
+class ControlBusBindingShm
+{
+public:
+    ControlBusBindingShm(): client(0) {}
+    server_shared_memory_client *client;
+};
+
+ControlBusBinding::ControlBusBinding( QObject * parent ):
+    QObject(parent),
+    m_server_port(-1),
+    m_bus(0),
+    m_control_bus_count(ShmClientPool::DefaultControlBusCount),
+    m_bus_valid(true),
+    m_write_back(false),
+    m_running(false),
+    m_start_on_completion(false),
+    m_complete(false),
+    m_value(0.f),
+    m_has_value(false),
+    m_writing_property(false),
+    m_shm(new ControlBusBindingShm)
+{}
+
+ControlBusBinding::~ControlBusBinding()
+{
+    stop();
+    delete m_shm;
+}
+
+void ControlBusBinding::setServerPort( int port )
+{
+    if (m_running) {
+        qWarning( "ControlBusBinding: Can not change server port while running!" );
+        return;
+    }
+
+    m_server_port = port;
+}
+
+void ControlBusBinding::setBus( int bus )
+{
+    m_bus = qMax(0, bus);
+    m_has_value = false;
+    checkBus();
+}
+
+void ControlBusBinding::setControlBusCount( int count )
+{
+    m_control_bus_count = qMax(0, count);
+    checkBus();
+}
+
+void ControlBusBinding::checkBus()
+{
+    m_bus_valid = m_bus < m_control_bus_count;
+    if (!m_bus_valid)
+        qWarning( "ControlBusBinding: Bus %d is beyond the %d control buses of the server!",
+                  m_bus, m_control_bus_count );
+}
+
+void ControlBusBinding::setTarget( QObject * target )
+{
+    m_target = target;
+    connectProperty();
+}
+
+void ControlBusBinding::setProperty( const QString & name )
+{
+    m_property_name = name;
+    connectProperty();
+}
+
+void ControlBusBinding::connectProperty()
+{
+    if (m_property.isValid() && m_property.object())
+        QObject::disconnect( m_property.object(), 0, this, SLOT(onPropertyChanged()) );
+
+    m_property = QQmlProperty();
+    m_has_value = false;
+
+    if (!m_target || m_property_name.isEmpty())
+        return;
+
+    QQmlProperty property( m_target, m_property_name );
+    if (!property.isProperty() || !property.isWritable()) {
+        qWarning() << "ControlBusBinding: No such writable property:" << m_property_name;
+        return;
+    }
+
+    m_property = property;
+
+    if (m_property.hasNotifySignal())
+        m_property.connectNotifySignal( this, SLOT(onPropertyChanged()) );
+}
+
+void ControlBusBinding::setRunning( bool running )
+{
+    if (!m_complete) {
+        m_start_on_completion = running;
+        return;
+    }
+
+    if (running)
+        start();
+    else
+        stop();
+}
+
+void ControlBusBinding::componentComplete()
+{
+    m_complete = true;
+    if (m_start_on_completion)
+        start();
+}
+
+void ControlBusBinding::start()
+{
+    if (m_running) return;
+    if (m_server_port < 0) return;
+
+    m_shm->client = ShmClientPool::acquire( m_server_port, "ControlBusBinding" );
+    if (!m_shm->client)
+        return;
+
+    m_has_value = false;
+
+    // Poll once per frame of the primary screen.
+    qreal refresh_rate = 60;
+    QScreen *screen = QGuiApplication::primaryScreen();
+    if (screen && screen->refreshRate() > 0)
+        refresh_rate = screen->refreshRate();
+    m_timer.start( qMax(1, qRound(1000.0 / refresh_rate)), Qt::PreciseTimer, this );
+
+    m_running = true;
+
+    emit runningChanged(m_running);
+
+    poll();
+}
+
+void ControlBusBinding::stop()
+{
+    if (!m_running) return;
+
+    m_timer.stop();
+
+    ShmClientPool::release( m_shm->client );
+    m_shm->client = 0;
+
+    m_running = false;
+
+    emit runningChanged(m_running);
+}
+
+void ControlBusBinding::timerEvent( QTimerEvent * event )
+{
+    if (event->timerId() == m_timer.timerId())
+        poll();
+    else
+        QObject::timerEvent(event);
+}
+
+void ControlBusBinding::poll()
+{
+    if (!m_target || !m_property.isValid() || !m_bus_valid)
+        return;
+
+    float value = m_shm->client->get_control_busses()[m_bus];
+
+    // Exact comparison: any change should reach the property,
+    // and NaN must not cause a write every frame.
+    if (m_has_value && (value == m_value || (value != value && m_value != m_value)))
+        return;
+
+    m_value = value;
+    m_has_value = true;
+
+    m_writing_property = true;
+    m_property.write( QVariant(static_cast<double>(value)) );
+    m_writing_property = false;
+}
+
+void ControlBusBinding::onPropertyChanged()
+{
+    if (!m_write_back || !m_running || m_writing_property || !m_bus_valid)
+        return;
+
+    bool ok;
+    float value = m_property.read().toFloat(&ok);
+    if (!ok)
+        return;
+
+    m_shm->client->get_control_busses()[m_bus] = value;
+
+    // Do not read the value back as a change.
+    m_value = value;
+    m_has_value = true;
+}
+
+} // namespace QuickCollider
@@ -0,0 +1,124 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_BUS_BINDING_INCLUDED
+#define QUICK_COLLIDER_BUS_BINDING_INCLUDED
+
+#include <QObject>
+#include <QQmlParserStatus>
+#include <QQmlProperty>
+#include <QBasicTimer>
+#include <QPointer>
+
+namespace QuickCollider
+{
+class ControlBusBindingShm;
+
+// Binds a property of any object to a server control bus, read directly
+// from shared memory.
+//
+// The bus is polled once per screen refresh and the property is only written
+// when the bus value has changed. With 'writeBack' enabled, changes of the
+// property (e.g. by user interaction with a slider) are also written to the bus.
+//
+// The shared memory interface does not tell the amount of control buses, so
+// 'controlBusCount' must be set to bind buses beyond
+// ShmClientPool::DefaultControlBusCount, if the server has them. Buses beyond
+// it are neither read nor written.
+
+class ControlBusBinding : public QObject, public QQmlParserStatus
+{
+    Q_OBJECT
+    Q_INTERFACES(QQmlParserStatus)
+    Q_PROPERTY( int server READ serverPort WRITE setServerPort )
+    Q_PROPERTY( int bus READ bus WRITE setBus )
+    Q_PROPERTY( int controlBusCount READ controlBusCount WRITE setControlBusCount )
+    Q_PROPERTY( QObject * target READ target WRITE setTarget )
+    Q_PROPERTY( QString property READ property WRITE setProperty )
+    Q_PROPERTY( bool writeBack READ writeBack WRITE setWriteBack )
+    Q_PROPERTY( bool running READ running WRITE setRunning NOTIFY runningChanged )
+
+public:
+    ControlBusBinding( QObject * parent = 0 );
+    ~ControlBusBinding();
+
+    int serverPort() const { return m_server_port; }
+    void setServerPort( int );
+
+    int bus() const { return m_bus; }
+    void setBus( int bus );
+
+    // Amount of control buses of the server
+    int controlBusCount() const { return m_control_bus_count; }
+    void setControlBusCount( int count );
+
+    QObject * target() const { return m_target; }
+    void setTarget( QObject * target );
+
+    QString property() const { return m_property_name; }
+    void setProperty( const QString & name );
+
+    bool writeBack() const { return m_write_back; }
+    void setWriteBack( bool write_back ) { m_write_back = write_back; }
+
+    bool running() const { return m_running; }
+    void setRunning( bool running );
+
+    Q_INVOKABLE void start();
+    Q_INVOKABLE void stop();
+
+    void classBegin() {}
+    void componentComplete();
+
+signals:
+    void runningChanged( bool running );
+
+protected:
+    void timerEvent( QTimerEvent * );
+
+private Q_SLOTS:
+    void onPropertyChanged();
+
+private:
+    void connectProperty();
+    void checkBus();
+    void poll();
+
+    int m_server_port;
+    int m_bus;
+    int m_control_bus_count;
+    bool m_bus_valid;
+    QPointer<QObject> m_target;
+    QString m_property_name;
+    QQmlProperty m_property;
+    bool m_write_back;
+    bool m_running;
+    bool m_start_on_completion;
+    bool m_complete;
+
+    // Last value read from or written to the bus
+    float m_value;
+    bool m_has_value;
+    bool m_writing_property;
+
+    ControlBusBindingShm *m_shm;
+    QBasicTimer m_timer;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_BUS_BINDING_INCLUDED
@@ -0,0 +1,244 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bus_meters.hpp"
+#include "shm_client_pool.hpp"
+
+#include <QQuickWindow>
+#include <QSGGeometryNode>
+#include <QSGVertexColorMaterial>
+#include <QDebug>
+
+#include <cmath>
+
+namespace QuickCollider {
+
+// Wraps the shm interface, which moc can not process (see oscilloscope.hpp).
+class ControlBusShm
+{
+public:
+    ControlBusShm(): client(0) {}
+    server_shared_memory_client *client;
+};
+
+namespace {
+
+// Time constant of RMS averaging, in seconds
+const float rmsTime = 0.3f;
+// Fall-off of peak and released hold, in decibels per second
+const float peakFall = 20.f;
+
+const int verticesPerMeter = 18;
+
+void setQuad( QSGGeometry::ColoredPoint2D * v, float x1, float y1, float x2, float y2,
+              const QColor & color )
+{
+    // premultiplied
+    int a = color.alpha();
+    uchar r = color.red() * a / 255;
+    uchar g = color.green() * a / 255;
+    uchar b = color.blue() * a / 255;
+    v[0].set(x1, y1, r, g, b, a);
+    v[1].set(x2, y1, r, g, b, a);
+    v[2].set(x1, y2, r, g, b, a);
+    v[3].set(x2, y1, r, g, b, a);
+    v[4].set(x2, y2, r, g, b, a);
+    v[5].set(x1, y2, r, g, b, a);
+}
+
+} // namespace
+
+ControlBusMeters::ControlBusMeters( QQuickItem * parent ):
+    QQuickItem(parent),
+    m_server_port(-1),
+    m_first_bus(0),
+    m_count(0),
+    m_control_bus_count(ShmClientPool::DefaultControlBusCount),
+    m_range(60.f),
+    m_hold_time(1.f),
+    m_spacing(2.0),
+    m_rms_color(0, 200, 0),
+    m_peak_color(0, 120, 0),
+    m_hold_color(255, 200, 0),
+    m_running(false),
+    m_shm(new ControlBusShm)
+{
+    setFlag( QQuickItem::ItemHasContents, true );
+
+    connect( this, SIGNAL(windowChanged(QQuickWindow*)),
+             this, SLOT(onWindowChanged(QQuickWindow*)) );
+}
+
+ControlBusMeters::~ControlBusMeters()
+{
+    stop();
+    delete m_shm;
+}
+
+void ControlBusMeters::setServerPort( int port )
+{
+    if (m_running) {
+        qWarning( "ControlBusMeters: Can not change server port while running!" );
+        return;
+    }
+
+    m_server_port = port;
+}
+
+void ControlBusMeters::start()
+{
+    if (m_running) return;
+    if (m_server_port < 0) return;
+
+    m_shm->client = ShmClientPool::acquire( m_server_port, "ControlBusMeters" );
+    if (!m_shm->client)
+        return;
+
+    m_running = true;
+
+    emit runningChanged(m_running);
+
+    update();
+}
+
+void ControlBusMeters::stop()
+{
+    if (!m_running) return;
+
+    ShmClientPool::release( m_shm->client );
+    m_shm->client = 0;
+
+    m_running = false;
+
+    emit runningChanged(m_running);
+
+    update();
+}
+
+void ControlBusMeters::onWindowChanged( QQuickWindow * window )
+{
+    if (m_window)
+        disconnect( m_window, SIGNAL(frameSwapped()), this, SLOT(onFrameSwapped()) );
+
+    m_window = window;
+
+    // Queued, because emitted by the render thread.
+    if (window)
+        connect( window, SIGNAL(frameSwapped()), this, SLOT(onFrameSwapped()) );
+}
+
+void ControlBusMeters::onFrameSwapped()
+{
+    // Read buses again for every frame.
+    if (m_running)
+        update();
+}
+
+float ControlBusMeters::levelToFraction( float level ) const
+{
+    if (level <= 0.f)
+        return 0.f;
+    float db = 20.f * std::log10(level);
+    return qBound(0.f, 1.f + db / m_range, 1.f);
+}
+
+QSGNode * ControlBusMeters::updatePaintNode( QSGNode * oldNode, UpdatePaintNodeData * )
+{
+    // Only buses that exist
+    int count = qMin(m_count, m_control_bus_count - m_first_bus);
+
+    if (!m_running || count < 1) {
+        delete oldNode;
+        m_meters.clear();
+        m_clock.invalidate();
+        return 0;
+    }
+
+    QSGGeometryNode *node = static_cast<QSGGeometryNode*>(oldNode);
+    if (!node) {
+        node = new QSGGeometryNode;
+        QSGGeometry *geometry = new QSGGeometry(QSGGeometry::defaultAttributes_ColoredPoint2D(), 0);
+        geometry->setDrawingMode(GL_TRIANGLES);
+        node->setGeometry(geometry);
+        node->setFlag(QSGNode::OwnsGeometry);
+        QSGVertexColorMaterial *material = new QSGVertexColorMaterial;
+        node->setMaterial(material);
+        node->setFlag(QSGNode::OwnsMaterial);
+    }
+
+    QSGGeometry *geometry = node->geometry();
+    if (geometry->vertexCount() != count * verticesPerMeter)
+        geometry->allocate( count * verticesPerMeter );
+
+    if ((int) m_meters.size() != count)
+        m_meters.assign( count, MeterState() );
+
+    float dt = m_clock.isValid() ? m_clock.restart() * 0.001f : 0.f;
+    if (!m_clock.isValid())
+        m_clock.start();
+
+    float rms_weight = std::exp(-dt / rmsTime);
+    float fall = std::pow(10.f, -peakFall * dt / 20.f);
+
+    const float *busses = m_shm->client->get_control_busses() + m_first_bus;
+
+    float h = height();
+    float meter_width = (width() - m_spacing * (count - 1)) / count;
+    QSGGeometry::ColoredPoint2D *vertices = geometry->vertexDataAsColoredPoint2D();
+
+    for (int idx = 0; idx < count; ++idx)
+    {
+        MeterState & meter = m_meters[idx];
+        float level = std::fabs(busses[idx]);
+        if (!(level < 1e6f)) // also NaN
+            level = 0.f;
+
+        meter.power = rms_weight * meter.power + (1.f - rms_weight) * level * level;
+
+        meter.peak = qMax(level, meter.peak * fall);
+
+        meter.hold_age += dt;
+        if (meter.peak >= meter.hold) {
+            meter.hold = meter.peak;
+            meter.hold_age = 0.f;
+        }
+        else if (meter.hold_age > m_hold_time) {
+            meter.hold = qMax(meter.peak, meter.hold * fall);
+        }
+
+        float rms = levelToFraction( std::sqrt(meter.power) ) * h;
+        float peak = qMax(rms, levelToFraction( meter.peak ) * h);
+        float hold = levelToFraction( meter.hold ) * h;
+
+        float x1 = idx * (meter_width + m_spacing);
+        float x2 = x1 + meter_width;
+
+        QSGGeometry::ColoredPoint2D *v = vertices + idx * verticesPerMeter;
+        setQuad( v, x1, h - rms, x2, h, m_rms_color );
+        setQuad( v + 6, x1, h - peak, x2, h - rms, m_peak_color );
+        if (hold > 0.f)
+            setQuad( v + 12, x1, h - hold, x2, qMin(h, h - hold + 2.f), m_hold_color );
+        else
+            setQuad( v + 12, x1, h, x2, h, m_hold_color );
+    }
+
+    node->markDirty(QSGNode::DirtyGeometry);
+
+    return node;
+}
+
+} // namespace QuickCollider
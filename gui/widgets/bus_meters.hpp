@@ -0,0 +1,151 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_BUS_METERS_INCLUDED
+#define QUICK_COLLIDER_BUS_METERS_INCLUDED
+
+#include <QQuickItem>
+#include <QColor>
+#include <QElapsedTimer>
+#include <QPointer>
+
+#include <vector>
+
+namespace QuickCollider
+{
+class ControlBusShm;
+
+// A row of level meters, each showing the amplitude on one server control bus,
+// read directly from shared memory once per frame.
+//
+// Each meter shows RMS, peak and peak hold. All meters are drawn by a single
+// geometry node.
+//
+// NOTE: The shared memory interface does not tell the amount of control buses,
+// so 'controlBusCount' must be set to show meters beyond
+// ShmClientPool::DefaultControlBusCount, if the server has them.
+
+class ControlBusMeters : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY( int server READ serverPort WRITE setServerPort )
+    Q_PROPERTY( int firstBus READ firstBus WRITE setFirstBus )
+    Q_PROPERTY( int count READ count WRITE setCount )
+    Q_PROPERTY( int controlBusCount READ controlBusCount WRITE setControlBusCount )
+    Q_PROPERTY( float range READ range WRITE setRange )
+    Q_PROPERTY( float peakHoldTime READ peakHoldTime WRITE setPeakHoldTime )
+    Q_PROPERTY( qreal spacing READ spacing WRITE setSpacing )
+    Q_PROPERTY( QColor rmsColor READ rmsColor WRITE setRmsColor )
+    Q_PROPERTY( QColor peakColor READ peakColor WRITE setPeakColor )
+    Q_PROPERTY( QColor holdColor READ holdColor WRITE setHoldColor )
+    Q_PROPERTY( bool running READ running WRITE setRunning NOTIFY runningChanged )
+
+public:
+    ControlBusMeters( QQuickItem * parent = 0 );
+    ~ControlBusMeters();
+
+    int serverPort() const { return m_server_port; }
+    void setServerPort( int );
+
+    int firstBus() const { return m_first_bus; }
+    void setFirstBus( int bus ) { m_first_bus = qMax(0, bus); update(); }
+
+    int count() const { return m_count; }
+    void setCount( int count ) { m_count = qMax(0, count); update(); }
+
+    // Amount of control buses of the server
+    int controlBusCount() const { return m_control_bus_count; }
+    void setControlBusCount( int count ) { m_control_bus_count = qMax(0, count); update(); }
+
+    // Displayed decibels below full scale
+    float range() const { return m_range; }
+    void setRange( float range ) { m_range = qMax(1.f, range); update(); }
+
+    // In seconds
+    float peakHoldTime() const { return m_hold_time; }
+    void setPeakHoldTime( float seconds ) { m_hold_time = qMax(0.f, seconds); }
+
+    qreal spacing() const { return m_spacing; }
+    void setSpacing( qreal spacing ) { m_spacing = qMax(0.0, spacing); update(); }
+
+    QColor rmsColor() const { return m_rms_color; }
+    void setRmsColor( const QColor & c ) { m_rms_color = c; update(); }
+
+    QColor peakColor() const { return m_peak_color; }
+    void setPeakColor( const QColor & c ) { m_peak_color = c; update(); }
+
+    QColor holdColor() const { return m_hold_color; }
+    void setHoldColor( const QColor & c ) { m_hold_color = c; update(); }
+
+    bool running() const { return m_running; }
+    void setRunning( bool running )
+    {
+        if (running)
+            start();
+        else
+            stop();
+    }
+
+    Q_INVOKABLE void start();
+    Q_INVOKABLE void stop();
+
+signals:
+    void runningChanged( bool running );
+
+protected:
+    QSGNode * updatePaintNode( QSGNode * oldNode, UpdatePaintNodeData * );
+
+private Q_SLOTS:
+    void onWindowChanged( QQuickWindow * window );
+    void onFrameSwapped();
+
+private:
+    struct MeterState
+    {
+        MeterState(): power(0.f), peak(0.f), hold(0.f), hold_age(0.f) {}
+
+        float power;
+        float peak;
+        float hold;
+        float hold_age;
+    };
+
+    float levelToFraction( float level ) const;
+
+    int m_server_port;
+    int m_first_bus;
+    int m_count;
+    int m_control_bus_count;
+    float m_range;
+    float m_hold_time;
+    qreal m_spacing;
+    QColor m_rms_color;
+    QColor m_peak_color;
+    QColor m_hold_color;
+    bool m_running;
+
+    ControlBusShm *m_shm;
+    QPointer<QQuickWindow> m_window;
+
+    // Only used by the render thread
+    std::vector<MeterState> m_meters;
+    QElapsedTimer m_clock;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_BUS_METERS_INCLUDED
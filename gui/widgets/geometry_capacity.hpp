@@ -0,0 +1,64 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_GEOMETRY_CAPACITY_INCLUDED
+#define QUICK_COLLIDER_GEOMETRY_CAPACITY_INCLUDED
+
+#include <QSGGeometry>
+
+#include <cstring>
+
+namespace QuickCollider {
+
+// QSGGeometry reallocates its vertex data whenever the vertex count changes,
+// and always draws all of it. For line strips whose length changes often,
+// these keep the vertex data at a high-water mark instead, and collapse the
+// unused tail onto the last used vertex, which draws nothing.
+//
+// Call reserveLineStrip() before writing 'count' vertices, and
+// padLineStrip() after.
+
+inline void reserveLineStrip( QSGGeometry & geometry, int count )
+{
+    int capacity = geometry.vertexCount();
+    // Shrink only when much smaller, so fluctuating counts do not reallocate.
+    if (count > capacity || count < capacity / 4)
+        geometry.allocate( count + count / 8 );
+}
+
+inline void padLineStrip( QSGGeometry & geometry, int count )
+{
+    int capacity = geometry.vertexCount();
+    if (count >= capacity)
+        return;
+
+    int vertex_size = geometry.sizeOfVertex();
+    char *data = static_cast<char*>( geometry.vertexData() );
+
+    if (count < 1) {
+        std::memset( data, 0, capacity * vertex_size );
+        return;
+    }
+
+    const char *last = data + (count - 1) * vertex_size;
+    for (int idx = count; idx < capacity; ++idx)
+        std::memcpy( data + idx * vertex_size, last, vertex_size );
+}
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_GEOMETRY_CAPACITY_INCLUDED
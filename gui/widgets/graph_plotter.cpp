@@ -1,5 +1,6 @@
 #include "graph_plotter.hpp"
 #include "../model/graph_model.hpp"
+#include "geometry_capacity.hpp"
 
 #include <QSGGeometryNode>
 #include <QSGGeometry>
@@ -46,6 +47,8 @@ QSGNode * GraphPlotter::updatePaintNode(QSGNode * oldNode,
         geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), count);
         geometry->setDrawingMode(GL_LINE_STRIP);
         geometry->setLineWidth(1);
+        // Changed by every edit
+        geometry->setVertexDataPattern(QSGGeometry::DynamicPattern);
         node->setGeometry(geometry);
         node->setFlag(QSGNode::OwnsGeometry);
 
@@ -55,7 +58,7 @@ QSGNode * GraphPlotter::updatePaintNode(QSGNode * oldNode,
         node->setFlag(QSGNode::OwnsMaterial);
     } else {
         geometry = node->geometry();
-        geometry->allocate(count);
+        reserveLineStrip(*geometry, count);
     }
 
     QSGGeometry::Point2D *vertices = geometry->vertexDataAsPoint2D();
@@ -65,6 +68,7 @@ QSGNode * GraphPlotter::updatePaintNode(QSGNode * oldNode,
         QPointF point = model->data(modelIndex, GraphModel::NodePosition).value<QPointF>();
         vertices[idx].set(point.x(), point.y());
     }
+    padLineStrip(*geometry, count);
     node->markDirty(QSGNode::DirtyGeometry);
 
     return node;
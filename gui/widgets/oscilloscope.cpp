@@ -21,12 +21,21 @@
 
 #include "oscilloscope.hpp"
 #include "oscilloscope_shm.hpp"
+#include "shm_client_pool.hpp"
+#include "scope_kernels.hpp"
+#include "scope_trace.hpp"
+#include "scope_persistence.hpp"
+#include "geometry_capacity.hpp"
 
 #include <QSGGeometryNode>
 #include <QSGTransformNode>
 #include <QSGFlatColorMaterial>
+#include <QQuickWindow>
 #include <QDebug>
 
+#include <cmath>
+#include <cstring>
+
 namespace QuickCollider {
 
 Oscilloscope::Oscilloscope( QQuickItem * parent) :
@@ -34,20 +43,28 @@ Oscilloscope::Oscilloscope( QQuickItem * parent) :
     _srvPort(-1),
     _scopeIndex(-1),
     _shm(new OscilloscopeShm(this)),
+    _reader(new ScopeReaderThread(_shm, this)),
     _running(false),
-    _data(0),
-    _availableFrames(0),
     mXOffset( 0.f ),
     mYOffset( 0.f ),
     mXZoom( 1.f ),
     mYZoom( 1.f ),
-    _mode( TrackMode )
+    _mode( TrackMode ),
+    m_dirty_top_node( false ),
+    m_dirty_colors( false ),
+    m_dirty_data( false ),
+    m_trigger_armed( true ),
+    m_persistence( 0.f ),
+    m_statistics_enabled( false )
 {
     setFlag( QQuickItem::ItemHasContents, true );
 
+    _reader->setTriggerSettings( m_trigger );
+    _reader->setSpectrumSettings( m_spectrum );
+
     timer = new QTimer( this );
     timer->setInterval( 50 );
-    connect( timer, SIGNAL( timeout() ), this, SLOT( pullData() ) );
+    connect( timer, SIGNAL( timeout() ), this, SLOT( checkFrames() ) );
 }
 
 Oscilloscope::~Oscilloscope()
@@ -69,7 +86,10 @@ void Oscilloscope::setBufferNumber( int n )
 {
     if( _running ) {
         // TODO: release used reader?
+        _reader->stopReading();
+        _reader->frames().clear();
         initScopeReader( _shm, n );
+        _reader->start();
     }
     _scopeIndex = n;
 }
@@ -95,6 +115,7 @@ void Oscilloscope::start()
 
     initScopeReader( _shm, _scopeIndex );
 
+    _reader->start();
     timer->start();
 
     _running = true;
@@ -106,7 +127,11 @@ void Oscilloscope::stop()
 {
     // TODO: release used reader?
 
-    delete _shm->client;
+    _reader->stopReading();
+    _reader->frames().clear();
+
+    _shm->reader = scope_buffer_reader();
+    ShmClientPool::release( _shm->client );
     _shm->client = 0;
 
     timer->stop();
@@ -116,30 +141,157 @@ void Oscilloscope::stop()
     emit runningChanged(_running);
 }
 
-void Oscilloscope::pullData()
+void Oscilloscope::setMode( Mode mode )
+{
+    _mode = mode;
+    m_dirty_top_node = true;
+
+    switch (mode) {
+    case TriggeredMode:
+        _reader->setProcessing( ScopeReaderThread::TriggerFrames ); break;
+    case SpectrumMode:
+        _reader->setProcessing( ScopeReaderThread::AnalyzeSpectrum ); break;
+    default:
+        _reader->setProcessing( ScopeReaderThread::CopyFrames );
+    }
+}
+
+void Oscilloscope::setTriggerMode( TriggerMode mode )
 {
-    bool valid = _shm->reader.valid();
-    //qcDebugMsg(1, tr("valid = %1").arg(valid));
-    if(!valid) return;
+    m_trigger.mode = (ScopeTriggerSettings::Mode) mode;
+    _reader->setTriggerSettings( m_trigger );
+}
 
-    bool ok = _shm->reader.pull( _availableFrames );
-    //qcDebugMsg(1, tr("Got %1 frames").arg(_availableFrames) );
-    if(ok) {
-        _data = _shm->reader.data();
-        update();
+void Oscilloscope::setTriggerSlope( TriggerSlope slope )
+{
+    m_trigger.rising = slope == RisingSlope;
+    _reader->setTriggerSettings( m_trigger );
+}
+
+void Oscilloscope::setTriggerChannel( int channel )
+{
+    m_trigger.channel = channel;
+    _reader->setTriggerSettings( m_trigger );
+}
+
+void Oscilloscope::setTriggerLevel( float level )
+{
+    m_trigger.level = level;
+    _reader->setTriggerSettings( m_trigger );
+}
+
+void Oscilloscope::setTriggerHysteresis( float hysteresis )
+{
+    m_trigger.hysteresis = qMax(0.f, hysteresis);
+    _reader->setTriggerSettings( m_trigger );
+}
+
+void Oscilloscope::setTriggerHoldoff( int frames )
+{
+    m_trigger.holdoff = qMax(0, frames);
+    _reader->setTriggerSettings( m_trigger );
+}
+
+void Oscilloscope::setSpectrumBins( int bins )
+{
+    m_spectrum.bins = qBound(2, bins, 4096);
+    _reader->setSpectrumSettings( m_spectrum );
+}
+
+void Oscilloscope::setSpectrumAveraging( float averaging )
+{
+    m_spectrum.averaging = qBound(0.f, averaging, 0.999f);
+    _reader->setSpectrumSettings( m_spectrum );
+}
+
+void Oscilloscope::setSpectrumRange( float range )
+{
+    m_spectrum.range = qMax(1.f, range);
+    _reader->setSpectrumSettings( m_spectrum );
+}
+
+void Oscilloscope::setPersistence( float seconds )
+{
+    seconds = qMax(0.f, seconds);
+    // Switching between persistence and plain display needs a different node.
+    if ((seconds > 0.f) != (m_persistence > 0.f))
+        m_dirty_top_node = true;
+    m_persistence = seconds;
+    update();
+}
+
+void Oscilloscope::setStatisticsEnabled( bool enabled )
+{
+    m_statistics_enabled = enabled;
+    _reader->setStatisticsEnabled( enabled );
+    if (!enabled && !m_statistics.isEmpty()) {
+        m_statistics.clear();
+        emit statisticsChanged( m_statistics );
     }
 }
 
+void Oscilloscope::armTrigger()
+{
+    _reader->armTrigger();
+}
+
+void Oscilloscope::checkFrames()
+{
+    bool armed = _reader->isTriggerArmed();
+    if (armed != m_trigger_armed) {
+        m_trigger_armed = armed;
+        emit triggerArmedChanged( armed );
+    }
+
+    if (m_statistics_enabled && _reader->takeStatistics( m_statistics_buffer ))
+    {
+        m_statistics.clear();
+        m_statistics.reserve( m_statistics_buffer.size() );
+        for (size_t ch = 0; ch < m_statistics_buffer.size(); ++ch) {
+            const ScopeChannelStatistics & stats = m_statistics_buffer[ch];
+            QVariantMap channel;
+            channel.insert( "peak", stats.peak );
+            channel.insert( "rms", stats.rms );
+            channel.insert( "dc", stats.dc );
+            channel.insert( "crest", stats.crest );
+            channel.insert( "zeroCrossingRate", stats.zero_crossing_rate );
+            m_statistics.append( channel );
+        }
+        emit statisticsChanged( m_statistics );
+
+        for (size_t ch = 0; ch < m_statistics_buffer.size(); ++ch) {
+            const ScopeChannelStatistics & stats = m_statistics_buffer[ch];
+            emit channelStatisticsChanged( ch, stats.peak, stats.rms, stats.dc, stats.crest,
+                                           stats.zero_crossing_rate );
+        }
+    }
+
+    // The frame itself is picked up in updatePaintNode.
+    if (_reader->frames().hasFresh())
+        update();
+}
+
 QSGNode * Oscilloscope::updatePaintNode(QSGNode * oldNode,
                                          UpdatePaintNodeData * updatePaintNodeData)
 {
-    if (!_running || _availableFrames < 2) {
+    if (!_running) {
+        delete oldNode;
+        return 0;
+    }
+
+    // The GUI thread is blocked here, and the reader thread only ever
+    // touches the back buffer, so the front frame is safe to use.
+    ScopeFrameBuffer & buffer = _reader->frames();
+    if (buffer.acquire())
+        m_dirty_data = true;
+
+    const ScopeFrame & frame = buffer.front();
+    if (frame.frames < 2) {
         delete oldNode;
         return 0;
     }
 
-    int channel_count = _shm->reader.channels();
-    int max_frame_count = _shm->reader.max_frames();
+    int channel_count = frame.channels;
 
     if (m_dirty_top_node) {
         delete oldNode;
@@ -147,23 +299,36 @@ QSGNode * Oscilloscope::updatePaintNode(QSGNode * oldNode,
         m_dirty_top_node = false;
     }
 
+    if (m_persistence > 0.f)
+        return updatePersistenceNode(oldNode, frame);
+
     switch (_mode)
     {
     case TrackMode:
     case OverlayMode:
+    case TriggeredMode:
+    case SpectrumMode:
     {
         MultiTrackPlotter *node = static_cast<MultiTrackPlotter*>(oldNode);
-        if (!node)
-            node = new MultiTrackPlotter;
+        if (!node) {
+            node = new MultiTrackPlotter( ScopeTraceMaterial::isSupported() );
+            m_dirty_data = true;
+            m_dirty_colors = true;
+        }
 
-        node->setDataFormat( channel_count, _availableFrames );
+        if (node->setDataFormat( channel_count, frame.frames ))
+            m_dirty_colors = true;
         node->setSize( width(), height() );
-        node->setScaling(mYZoom);
+        node->setScaling(mYZoom, mYOffset);
+        node->setXScaling(mXZoom, mXOffset);
         node->setOverlay(_mode == OverlayMode);
 
-        for( int ch = 0; ch < channel_count; ++ch ) {
-            float *channel_data = _data + (ch * max_frame_count); //frame vector
-            node->setChannelData(ch, channel_data);
+        // Only upload when there is new data; a change of size, zoom or offset
+        // alone does not need it.
+        if (m_dirty_data) {
+            for( int ch = 0; ch < channel_count; ++ch )
+                node->setChannelData(ch, frame.channel(ch));
+            m_dirty_data = false;
         }
 
         if (m_dirty_colors && m_colors.count())
@@ -173,6 +338,7 @@ QSGNode * Oscilloscope::updatePaintNode(QSGNode * oldNode,
                 int color_idx = ch % colors_count;
                 node->setChannelColor( ch, m_colors[color_idx].value<QColor>() );
             }
+            m_dirty_colors = false;
         }
 
         return node;
@@ -180,21 +346,25 @@ QSGNode * Oscilloscope::updatePaintNode(QSGNode * oldNode,
     case XYMode:
     {
         XYPlotter *node = static_cast<XYPlotter*>(oldNode);
-        if (!node)
+        if (!node) {
             node = new XYPlotter;
+            m_dirty_colors = true;
+        }
 
         node->setSize( width(), height() );
         node->setScaling(mXZoom, mYZoom);
 
         if ( channel_count >= 2)
         {
-            node->setData( _data,
-                           _data + max_frame_count,
-                           _availableFrames );
+            node->setData( frame.channel(0),
+                           frame.channel(1),
+                           frame.frames );
         }
 
-        if (m_dirty_colors && m_colors.count())
+        if (m_dirty_colors && m_colors.count()) {
             node->setColor( m_colors[0].value<QColor>() );
+            m_dirty_colors = false;
+        }
 
         return node;
     }
@@ -203,16 +373,64 @@ QSGNode * Oscilloscope::updatePaintNode(QSGNode * oldNode,
     }
 }
 
-void Oscilloscope::connectSharedMemory( int port )
+QSGNode * Oscilloscope::updatePersistenceNode( QSGNode * oldNode, const ScopeFrame & frame )
 {
-    try {
-        server_shared_memory_client * client = new server_shared_memory_client(port);
-        _shm->client = client;
-        qDebug("Oscilloscope: Shared memory connected");
-    } catch (std::exception & e) {
-        _shm->client = 0;
-        qWarning() << "Oscilloscope: Cannot connect to shared memory:" << e.what();
+    PersistenceNode *node = static_cast<PersistenceNode*>(oldNode);
+    if (!node) {
+        node = new PersistenceNode( window() );
+        m_dirty_data = true;
     }
+
+    QSizeF size( width(), height() );
+    node->setRect( boundingRect() );
+    node->setTextureSize( (size * window()->effectiveDevicePixelRatio()).toSize() );
+    node->setDecayTime( m_persistence );
+
+    if (!m_dirty_data)
+        return node;
+
+    m_dirty_data = false;
+
+    const ScopeKernels & kernels = ScopeKernels::get();
+    int colors_count = m_colors.count();
+
+    if (_mode == XYMode)
+    {
+        if (frame.channels < 2)
+            return node;
+        QColor color = colors_count ? m_colors[0].value<QColor>() : QColor(Qt::white);
+        float *vertices = node->addStrip( frame.frames,
+                                          XYPlotter::xyMatrix(size, mXZoom, mYZoom), color );
+        kernels.xyVertices( frame.channel(0), frame.channel(1), vertices, frame.frames );
+        return node;
+    }
+
+    int columns = std::ceil(size.width() * mXZoom);
+    bool reduce = columns > 0 && frame.frames > columns;
+    bool overlay = _mode == OverlayMode;
+
+    for (int ch = 0; ch < frame.channels; ++ch)
+    {
+        QMatrix4x4 matrix = MultiTrackPlotter::trackMatrix( ch, frame.channels, frame.frames, size,
+                                                            overlay, mYZoom, mYOffset,
+                                                            mXZoom, mXOffset );
+        QColor color = colors_count ? m_colors[ch % colors_count].value<QColor>() : QColor(Qt::white);
+        if (reduce) {
+            float *vertices = node->addStrip( columns * 2, matrix, color );
+            kernels.minMaxVertices( frame.channel(ch), frame.frames, columns, vertices );
+        } else {
+            float *vertices = node->addStrip( frame.frames, matrix, color );
+            kernels.indexedVertices( frame.channel(ch), vertices, frame.frames );
+        }
+    }
+
+    return node;
+}
+
+void Oscilloscope::connectSharedMemory( int port )
+{
+    // Other scopes on the same server share the client.
+    _shm->client = ShmClientPool::acquire( port, "Oscilloscope" );
 }
 
 void Oscilloscope::initScopeReader( OscilloscopeShm *shm, int index )
@@ -221,29 +439,138 @@ void Oscilloscope::initScopeReader( OscilloscopeShm *shm, int index )
     qDebug() << "Oscilloscope: Initialized scope buffer reader for index:" << index;
 }
 
-MultiTrackPlotter::MultiTrackPlotter():
+void ScopeReaderThread::run()
+{
+    // Much shorter than any useful scope buffer, so no frame is missed.
+    static const unsigned long pollInterval = 2;
+
+    scope_buffer_reader & reader = m_shm->reader;
+    int processing = CopyFrames;
+
+    while (!m_quit)
+    {
+        if (m_settings_changed.exchange(false)) {
+            QMutexLocker locker(&m_settings_mutex);
+            m_trigger.setSettings( m_pending_settings );
+        }
+        if (m_spectrum_settings_changed.exchange(false)) {
+            QMutexLocker locker(&m_settings_mutex);
+            m_spectrum.setSettings( m_pending_spectrum_settings );
+        }
+        if (m_arm_requested.exchange(false))
+            m_trigger.arm();
+        if (processing != m_processing) {
+            processing = m_processing;
+            m_trigger.reset();
+            m_spectrum.reset();
+        }
+
+        unsigned int frame_count;
+        if (reader.valid() && reader.pull( frame_count ))
+        {
+            int channel_count = reader.channels();
+            int max_frame_count = reader.max_frames();
+            const float *data = reader.data();
+
+            if (m_statistics_enabled && frame_count > 0) {
+                computeScopeStatistics( data, channel_count, frame_count, max_frame_count,
+                                        m_statistics_work );
+                QMutexLocker locker(&m_statistics_mutex);
+                m_statistics.swap( m_statistics_work );
+                m_statistics_fresh = true;
+            }
+
+            if (processing == TriggerFrames) {
+                if (m_trigger.process( data, channel_count, frame_count, max_frame_count,
+                                       m_frames.back() ))
+                    m_frames.publish();
+            }
+            else if (processing == AnalyzeSpectrum) {
+                if (m_spectrum.process( data, channel_count, frame_count, max_frame_count,
+                                        m_frames.back() ))
+                    m_frames.publish();
+            }
+            else if (processing == SpectrumColumns) {
+                int channel = m_column_channel;
+                if (channel >= 0 && channel < channel_count
+                        && m_spectrum.process( data + channel * max_frame_count, 1,
+                                               frame_count, max_frame_count,
+                                               m_column_spectrum ))
+                    queueColumn( m_column_spectrum );
+            }
+            else {
+                ScopeFrame & frame = m_frames.back();
+                frame.resize( channel_count, frame_count );
+                for (int ch = 0; ch < channel_count; ++ch)
+                    std::memcpy( frame.channel(ch), data + ch * max_frame_count,
+                                 frame_count * sizeof(float) );
+                m_frames.publish();
+            }
+        }
+
+        m_trigger_armed = m_trigger.isSingleArmed();
+
+        msleep( pollInterval );
+    }
+}
+
+void ScopeReaderThread::queueColumn( const ScopeFrame & spectrum )
+{
+    int bins = spectrum.frames;
+
+    QMutexLocker locker(&m_columns_mutex);
+
+    // Columns of a previous amount of bins can not be mixed with new ones.
+    if (bins != m_column_bins) {
+        m_columns.clear();
+        m_column_bins = bins;
+    }
+
+    size_t max_size = (size_t) qMax(1, (int) m_max_columns) * bins;
+    if (m_columns.size() + bins > max_size) {
+        size_t excess = qMin(m_columns.size(), m_columns.size() + bins - max_size);
+        m_columns.erase( m_columns.begin(), m_columns.begin() + excess );
+    }
+
+    const float *values = spectrum.channel(0);
+    for (int idx = 0; idx < bins; ++idx)
+        m_columns.push_back( (unsigned char) ((values[idx] + 1.f) * 127.5f) );
+}
+
+MultiTrackPlotter::MultiTrackPlotter( bool valueOnly ):
+    m_value_only(valueOnly),
     m_frame_count(0),
     m_channel_count(0),
     m_overlay(false),
     m_scaling(1.0),
+    m_y_offset(0.0),
+    m_x_zoom(1.0),
+    m_x_offset(0.0),
     m_width(1.0),
     m_height(1.0)
 {}
 
-void MultiTrackPlotter::setDataFormat( int channels, int frames )
+bool MultiTrackPlotter::setDataFormat( int channels, int frames )
 {
     if (channels == m_channel_count && frames == m_frame_count)
-        return;
+        return false;
 
     m_frame_count = frames;
 
-    if (channels != m_channel_count)
+    bool rebuild = channels != m_channel_count;
+    if (rebuild)
     {
         m_channel_count = channels;
 
         removeAllChildNodes();
 
-        for (int idx = 0; idx < m_channel_count; ++idx)
+        if (m_value_only) {
+            // All channels share one node, drawn in a single call.
+            ScopeTraceNode *traceNode = new ScopeTraceNode;
+            traceNode->setFormat(m_channel_count, m_frame_count, 0);
+            this->appendChildNode(traceNode);
+        }
+        else for (int idx = 0; idx < m_channel_count; ++idx)
         {
             PlotNode1D *plotNode = new PlotNode1D;
             QSGTransformNode *transformNode = new QSGTransformNode;
@@ -253,15 +580,32 @@ void MultiTrackPlotter::setDataFormat( int channels, int frames )
     }
 
     updateTransform();
+
+    return rebuild;
 }
 
-void MultiTrackPlotter::setChannelData( int channel, float *data )
+void MultiTrackPlotter::setChannelData( int channel, const float *data )
 {
     Q_ASSERT(channel >= 0 && channel < m_channel_count);
 
+    // With more frames than pixel columns, reduce each column to its min-max span.
+    // This looks the same, but needs far fewer vertices.
+    int columns = std::ceil(m_width * m_x_zoom);
+    bool reduce = columns > 0 && m_frame_count > columns;
+
+    if (m_value_only) {
+        ScopeTraceNode *traceNode = static_cast<ScopeTraceNode*>( firstChild() );
+        traceNode->setFormat(m_channel_count, m_frame_count, reduce ? columns : 0);
+        traceNode->setChannelData(channel, data);
+        return;
+    }
+
     QSGNode *transformNode = childAtIndex(channel);
     PlotNode1D *plotNode = static_cast<PlotNode1D*>( transformNode->childAtIndex(0) );
-    plotNode->setData(data, m_frame_count);
+    if (reduce)
+        plotNode->setMinMaxData(data, m_frame_count, columns);
+    else
+        plotNode->setData(data, m_frame_count);
 }
 
 void MultiTrackPlotter::setOverlay( bool overlay )
@@ -281,11 +625,21 @@ void MultiTrackPlotter::setSize( qreal width, qreal height )
     updateTransform();
 }
 
-void MultiTrackPlotter::setScaling( qreal scaling )
+void MultiTrackPlotter::setScaling( qreal scaling, qreal offset )
 {
-    if (scaling == m_scaling)
+    if (scaling == m_scaling && offset == m_y_offset)
         return;
     m_scaling = scaling;
+    m_y_offset = offset;
+    updateTransform();
+}
+
+void MultiTrackPlotter::setXScaling( qreal zoom, qreal offset )
+{
+    if (zoom == m_x_zoom && offset == m_x_offset)
+        return;
+    m_x_zoom = zoom;
+    m_x_offset = offset;
     updateTransform();
 }
 
@@ -299,6 +653,11 @@ void MultiTrackPlotter::setColor( const QColor & color )
 
 void MultiTrackPlotter::setChannelColor( int channel, const QColor & color )
 {
+    if (m_value_only) {
+        static_cast<ScopeTraceNode*>( firstChild() )->setChannelColor(channel, color);
+        return;
+    }
+
     QSGNode *transformNode = childAtIndex(channel);
     PlotNode1D *plotNode = static_cast<PlotNode1D*>( transformNode->childAtIndex(0) );
     plotNode->setColor(color);
@@ -311,26 +670,58 @@ void MultiTrackPlotter::updateTransform()
     if (!m_overlay && m_channel_count > 1)
         y_scaling /= m_channel_count;
 
-    qreal x_scaling = m_width;
+    qreal x_scaling = m_width * m_x_zoom;
     if (m_frame_count > 1)
         x_scaling /= (m_frame_count - 1);
 
+    if (m_value_only) {
+        if (ScopeTraceNode *traceNode = static_cast<ScopeTraceNode*>( firstChild() )) {
+            qreal y_step = m_overlay ? 0.0 : 2.0 * y_scaling;
+            qreal value_scaling = y_scaling * m_scaling;
+            traceNode->setPlacement( m_x_offset, x_scaling,
+                                     y_scaling - m_y_offset * value_scaling, y_step,
+                                     value_scaling );
+        }
+        return;
+    }
+
     for (int idx = 0; idx < m_channel_count; ++idx)
     {
-        qreal y_translation = 1.0;
-        if (!m_overlay)
-            y_translation += idx * 2.0;
-
-        QMatrix4x4 matrix;
-        matrix.scale(x_scaling, y_scaling);
-        matrix.translate(0.0, y_translation);
-        matrix.scale(1.0, -m_scaling); // flip y axis!
+        QMatrix4x4 matrix = trackMatrix( idx, m_channel_count, m_frame_count,
+                                         QSizeF(m_width, m_height),
+                                         m_overlay, m_scaling, m_y_offset,
+                                         m_x_zoom, m_x_offset );
 
         QSGTransformNode *transformNode = static_cast<QSGTransformNode*>( childAtIndex(idx) );;
         transformNode->setMatrix(matrix);
     }
 }
 
+QMatrix4x4 MultiTrackPlotter::trackMatrix( int track, int tracks, int frames, const QSizeF & size,
+                                           bool overlay, qreal scaling, qreal yOffset,
+                                           qreal xZoom, qreal xOffset )
+{
+    qreal y_scaling = 1.0;
+    y_scaling *= size.height() * 0.5;
+    if (!overlay && tracks > 1)
+        y_scaling /= tracks;
+
+    qreal x_scaling = size.width() * xZoom;
+    if (frames > 1)
+        x_scaling /= (frames - 1);
+
+    qreal y_translation = 1.0;
+    if (!overlay)
+        y_translation += track * 2.0;
+
+    QMatrix4x4 matrix;
+    matrix.scale(x_scaling, y_scaling);
+    matrix.translate(-xOffset, y_translation);
+    matrix.scale(1.0, -scaling); // flip y axis!
+    matrix.translate(0.0, yOffset);
+    return matrix;
+}
+
 XYPlotter::XYPlotter():
     m_width(1.0),
     m_height(1.0),
@@ -364,21 +755,26 @@ void XYPlotter::setColor( const QColor & color )
     m_geom_node->setColor(color);
 }
 
-void XYPlotter::setData( float * x_data, float * y_data, int count )
+void XYPlotter::setData( const float * x_data, const float * y_data, int count )
 {
     m_geom_node->setData(x_data, y_data, count);
 }
 
 void XYPlotter::updateTransform()
 {
-    qreal size_scale = qMin(m_width, m_height);
+    setMatrix( xyMatrix(QSizeF(m_width, m_height), m_x_scaling, m_y_scaling) );
+}
+
+QMatrix4x4 XYPlotter::xyMatrix( const QSizeF & size, qreal x_scaling, qreal y_scaling )
+{
+    qreal size_scale = qMin(size.width(), size.height());
 
     QMatrix4x4 matrix;
-    matrix.translate(m_width * 0.5,
-                     m_height * 0.5);
-    matrix.scale(0.5 * size_scale * m_x_scaling,
-                 -0.5 * size_scale * m_y_scaling); // flip y axis!
-    setMatrix(matrix);
+    matrix.translate(size.width() * 0.5,
+                     size.height() * 0.5);
+    matrix.scale(0.5 * size_scale * x_scaling,
+                 -0.5 * size_scale * y_scaling); // flip y axis!
+    return matrix;
 }
 
 PlotNode1D::PlotNode1D():
@@ -386,21 +782,34 @@ PlotNode1D::PlotNode1D():
 {
     m_geometry.setDrawingMode(GL_LINE_STRIP);
     m_geometry.setLineWidth(1);
-    //m_geometry.setVertexDataPattern(QSGGeometry::DynamicPattern);
+    // Replaced on every frame
+    m_geometry.setVertexDataPattern(QSGGeometry::StreamPattern);
 
     setGeometry(&m_geometry);
     setMaterial(&m_material);
 }
 
-void PlotNode1D::setData( float * data, int count )
+void PlotNode1D::setData( const float * data, int count )
 {
-    if (m_geometry.vertexCount() != count)
-        m_geometry.allocate(count);
+    reserveLineStrip(m_geometry, count);
 
-    QSGGeometry::Point2D *vertices = m_geometry.vertexDataAsPoint2D();
+    float *vertices = reinterpret_cast<float*>( m_geometry.vertexDataAsPoint2D() );
+    ScopeKernels::get().indexedVertices( data, vertices, count );
+    padLineStrip(m_geometry, count);
 
-    for (int idx = 0; idx < count; ++idx)
-        vertices[idx].set( (float) idx, data[idx] );
+    markDirty(QSGNode::DirtyGeometry);
+}
+
+void PlotNode1D::setMinMaxData( const float * data, int count, int columns )
+{
+    Q_ASSERT(columns > 0 && count >= columns);
+
+    int vertex_count = columns * 2;
+    reserveLineStrip(m_geometry, vertex_count);
+
+    float *vertices = reinterpret_cast<float*>( m_geometry.vertexDataAsPoint2D() );
+    ScopeKernels::get().minMaxVertices( data, count, columns, vertices );
+    padLineStrip(m_geometry, vertex_count);
 
     markDirty(QSGNode::DirtyGeometry);
 }
@@ -416,21 +825,20 @@ PlotNode2D::PlotNode2D():
 {
     m_geometry.setDrawingMode(GL_LINE_STRIP);
     m_geometry.setLineWidth(1);
-    //m_geometry.setVertexDataPattern(QSGGeometry::DynamicPattern);
+    // Replaced on every frame
+    m_geometry.setVertexDataPattern(QSGGeometry::StreamPattern);
 
     setGeometry(&m_geometry);
     setMaterial(&m_material);
 }
 
-void PlotNode2D::setData( float * x_data, float * y_data, int count )
+void PlotNode2D::setData( const float * x_data, const float * y_data, int count )
 {
-    if (m_geometry.vertexCount() != count)
-        m_geometry.allocate(count);
-
-    QSGGeometry::Point2D *vertices = m_geometry.vertexDataAsPoint2D();
+    reserveLineStrip(m_geometry, count);
 
-    for (int idx = 0; idx < count; ++idx)
-        vertices[idx].set( x_data[idx], y_data[idx] );
+    float *vertices = reinterpret_cast<float*>( m_geometry.vertexDataAsPoint2D() );
+    ScopeKernels::get().xyVertices( x_data, y_data, vertices, count );
+    padLineStrip(m_geometry, count);
 
     markDirty(QSGNode::DirtyGeometry);
 }
@@ -28,6 +28,12 @@
 #include <QSGFlatColorMaterial>
 #include <QTimer>
 
+#include "scope_trigger.hpp"
+#include "scope_spectrum.hpp"
+#include "scope_statistics.hpp"
+
+#include <vector>
+
 
 // FIXME: Due to Qt bug #22829, moc can not process headers that include
 // boost/type_traits/detail/has_binary_operator.hp from boost 1.48, so
@@ -36,12 +42,13 @@
 namespace QuickCollider
 {
 class OscilloscopeShm;
+class ScopeReaderThread;
 class PlotNode2D;
 
 class Oscilloscope : public QQuickItem
 {
     Q_OBJECT
-    Q_ENUMS( Mode )
+    Q_ENUMS( Mode TriggerMode TriggerSlope )
     Q_PROPERTY( int server READ serverPort WRITE setServerPort )
     Q_PROPERTY( int buffer READ bufferNumber WRITE setBufferNumber )
     Q_PROPERTY( float xOffset READ xOffset WRITE setXOffset )
@@ -52,12 +59,40 @@ class Oscilloscope : public QQuickItem
     Q_PROPERTY( QVariantList trackColors READ trackColors WRITE setTrackColors )
     Q_PROPERTY( int updateInterval READ updateInterval WRITE setUpdateInterval )
     Q_PROPERTY( bool running READ running WRITE setRunning NOTIFY runningChanged )
+    Q_PROPERTY( TriggerMode triggerMode READ triggerMode WRITE setTriggerMode )
+    Q_PROPERTY( TriggerSlope triggerSlope READ triggerSlope WRITE setTriggerSlope )
+    Q_PROPERTY( int triggerChannel READ triggerChannel WRITE setTriggerChannel )
+    Q_PROPERTY( float triggerLevel READ triggerLevel WRITE setTriggerLevel )
+    Q_PROPERTY( float triggerHysteresis READ triggerHysteresis WRITE setTriggerHysteresis )
+    Q_PROPERTY( int triggerHoldoff READ triggerHoldoff WRITE setTriggerHoldoff )
+    Q_PROPERTY( bool triggerArmed READ triggerArmed NOTIFY triggerArmedChanged )
+    Q_PROPERTY( int spectrumBins READ spectrumBins WRITE setSpectrumBins )
+    Q_PROPERTY( float spectrumAveraging READ spectrumAveraging WRITE setSpectrumAveraging )
+    Q_PROPERTY( float spectrumRange READ spectrumRange WRITE setSpectrumRange )
+    Q_PROPERTY( float persistence READ persistence WRITE setPersistence )
+    Q_PROPERTY( bool statisticsEnabled READ statisticsEnabled WRITE setStatisticsEnabled )
+    Q_PROPERTY( QVariantList statistics READ statistics NOTIFY statisticsChanged )
 
 public:
     enum Mode {
         TrackMode,
         OverlayMode,
-        XYMode
+        XYMode,
+        // Tracks, each window starting at a trigger point
+        TriggeredMode,
+        // Tracks of log-frequency magnitude spectra
+        SpectrumMode
+    };
+
+    enum TriggerMode {
+        AutoTrigger = ScopeTriggerSettings::Auto,
+        NormalTrigger = ScopeTriggerSettings::Normal,
+        SingleTrigger = ScopeTriggerSettings::Single
+    };
+
+    enum TriggerSlope {
+        RisingSlope,
+        FallingSlope
     };
 
     Oscilloscope( QQuickItem * parent = 0 );
@@ -69,19 +104,65 @@ public:
     int bufferNumber() const { return _scopeIndex; }
 
     float xOffset() const { return mXOffset; }
-    void setXOffset( float f ) { mXOffset = f; }
+    void setXOffset( float f ) { mXOffset = f; update(); }
 
+    // Added to sample values before yZoom, in all modes but XYMode.
     float yOffset() const { return mYOffset; }
-    void setYOffset( float f ) { mYOffset = f; }
+    void setYOffset( float f ) { mYOffset = f; update(); }
 
     float xZoom() const { return mXZoom; }
-    void setXZoom( float f ) { mXZoom = f; }
+    void setXZoom( float f ) { mXZoom = f; update(); }
 
     float yZoom() const { return mYZoom; }
-    void setYZoom( float f ) { mYZoom = f; }
+    void setYZoom( float f ) { mYZoom = f; update(); }
 
     Mode mode() const { return _mode; }
-    void setMode( Mode mode ) { _mode = mode; m_dirty_top_node = true; }
+    void setMode( Mode mode );
+
+    TriggerMode triggerMode() const { return (TriggerMode) m_trigger.mode; }
+    void setTriggerMode( TriggerMode );
+
+    TriggerSlope triggerSlope() const { return m_trigger.rising ? RisingSlope : FallingSlope; }
+    void setTriggerSlope( TriggerSlope );
+
+    int triggerChannel() const { return m_trigger.channel; }
+    void setTriggerChannel( int );
+
+    float triggerLevel() const { return m_trigger.level; }
+    void setTriggerLevel( float );
+
+    float triggerHysteresis() const { return m_trigger.hysteresis; }
+    void setTriggerHysteresis( float );
+
+    // In frames
+    int triggerHoldoff() const { return m_trigger.holdoff; }
+    void setTriggerHoldoff( int );
+
+    bool triggerArmed() const { return m_trigger_armed; }
+
+    int spectrumBins() const { return m_spectrum.bins; }
+    void setSpectrumBins( int );
+
+    float spectrumAveraging() const { return m_spectrum.averaging; }
+    void setSpectrumAveraging( float );
+
+    // In decibels
+    float spectrumRange() const { return m_spectrum.range; }
+    void setSpectrumRange( float );
+
+    // Decay time of traces in seconds, for a phosphor-like display; 0 is off.
+    float persistence() const { return m_persistence; }
+    void setPersistence( float );
+
+    // Per-channel statistics of the latest scope buffer, as a list of maps
+    // with keys "peak", "rms", "dc", "crest" and "zeroCrossingRate"
+    // (sign changes per frame). Updated at the update interval.
+    // channelStatisticsChanged() carries the same numbers as plain arguments,
+    // which can be sent to OSC subscribers.
+    bool statisticsEnabled() const { return m_statistics_enabled; }
+    void setStatisticsEnabled( bool );
+
+    QVariantList statistics() const { return m_statistics; }
 
     QVariantList trackColors() const { return m_colors; }
     void setTrackColors( const QVariantList & colors )
@@ -105,17 +186,24 @@ public:
 
     Q_INVOKABLE void start();
     Q_INVOKABLE void stop();
+    // Waits for another trigger in SingleTrigger mode.
+    Q_INVOKABLE void armTrigger();
 
 signals:
     void runningChanged( bool running );
+    void triggerArmedChanged( bool armed );
+    void statisticsChanged( const QVariantList & statistics );
+    void channelStatisticsChanged( int channel, float peak, float rms, float dc,
+                                   float crest, float zeroCrossingRate );
 
 protected:
     QSGNode * updatePaintNode(QSGNode * oldNode, UpdatePaintNodeData * updatePaintNodeData);
 
 private Q_SLOTS:
-    void pullData();
+    void checkFrames();
 
 private:
+    QSGNode * updatePersistenceNode( QSGNode * oldNode, const ScopeFrame & frame );
     void connectSharedMemory( int port );
     void initScopeReader( OscilloscopeShm *, int index );
 
@@ -123,10 +211,9 @@ private:
     int _scopeIndex;
 
     OscilloscopeShm *_shm;
+    ScopeReaderThread *_reader;
 
     bool _running;
-    float *_data;
-    uint _availableFrames;
 
     QTimer *timer;
     float mXOffset;
@@ -138,27 +225,52 @@ private:
 
     bool m_dirty_top_node;
     bool m_dirty_colors;
+    bool m_dirty_data;
+
+    ScopeTriggerSettings m_trigger;
+    bool m_trigger_armed;
+
+    SpectrumSettings m_spectrum;
+    float m_persistence;
+
+    bool m_statistics_enabled;
+    QVariantList m_statistics;
+    std::vector<ScopeChannelStatistics> m_statistics_buffer;
 };
 
 class MultiTrackPlotter : public QSGNode
 {
 public:
-    MultiTrackPlotter();
+    // With 'valueOnly', all tracks are packed into one ScopeTraceNode, uploading
+    // only sample values and placed using uniforms. Otherwise, tracks are PlotNode1Ds placed using
+    // transform nodes.
+    MultiTrackPlotter( bool valueOnly );
     void setOverlay( bool overlay );
-    void setDataFormat( int channels, int frames );
-    void setChannelData( int channel, float *data );
+    // Returns whether tracks were recreated (and so need new colors).
+    bool setDataFormat( int channels, int frames );
+    void setChannelData( int channel, const float *data );
     void setColor( const QColor & color );
     void setChannelColor( int channel, const QColor & color );
     void setSize( qreal width, qreal height );
-    void setScaling( qreal scaling );
+    void setScaling( qreal scaling, qreal offset );
+    void setXScaling( qreal zoom, qreal offset );
+
+    // Maps (frame, value) of a track to item coordinates.
+    static QMatrix4x4 trackMatrix( int track, int tracks, int frames, const QSizeF & size,
+                                   bool overlay, qreal scaling, qreal yOffset,
+                                   qreal xZoom, qreal xOffset );
 
 private:
     void updateTransform();
 
+    bool m_value_only;
     int m_frame_count;
     int m_channel_count;
     bool m_overlay;
     qreal m_scaling;
+    qreal m_y_offset;
+    qreal m_x_zoom;
+    qreal m_x_offset;
     qreal m_width;
     qreal m_height;
 };
@@ -171,7 +283,10 @@ public:
     void setSize( qreal width, qreal height );
     void setScaling( qreal x_scaling, qreal y_scaling );
     void setColor( const QColor & color );
-    void setData( float * x_data, float * y_data, int count );
+    void setData( const float * x_data, const float * y_data, int count );
+
+    // Maps (x,y) sample values to item coordinates.
+    static QMatrix4x4 xyMatrix( const QSizeF & size, qreal x_scaling, qreal y_scaling );
 
 private:
     void updateTransform();
@@ -187,7 +302,8 @@ class PlotNode1D : public QSGGeometryNode
 {
 public:
     PlotNode1D();
-    void setData( float * data, int count );
+    void setData( const float * data, int count );
+    void setMinMaxData( const float * data, int count, int columns );
     void setColor( const QColor & color );
 
 private:
@@ -199,7 +315,7 @@ class PlotNode2D: public QSGGeometryNode
 {
 public:
     PlotNode2D();
-    void setData( float * x_data, float * y_data, int count );
+    void setData( const float * x_data, const float * y_data, int count );
     void setColor( const QColor & color );
 
 private:
@@ -25,7 +25,17 @@
 // from SC source:
 #include <common/server_shm.hpp>
 
+#include "scope_frame_buffer.hpp"
+#include "scope_trigger.hpp"
+#include "scope_spectrum.hpp"
+#include "scope_statistics.hpp"
+
 #include <QObject>
+#include <QThread>
+#include <QMutex>
+
+#include <atomic>
+#include <vector>
 
 namespace QuickCollider {
 
@@ -39,6 +49,143 @@ public:
   scope_buffer_reader reader;
 };
 
+// Polls the scope buffer reader independently of the GUI thread, and copies
+// each complete frame into a triple buffer. The render thread then picks up
+// the freshest frame without locking, so a busy GUI thread does not drop
+// scope frames. Trigger search, spectrum analysis and statistics also happen here.
+//
+// With SpectrumColumns processing, frames are not published; instead, the
+// spectrum of one channel of each frame is queued as a column of 8-bit
+// intensities, for displays that keep a history of them.
+
+class ScopeReaderThread : public QThread {
+public:
+  ScopeReaderThread(OscilloscopeShm *shm, QObject *parent) :
+    QThread(parent), m_shm(shm), m_quit(false),
+    m_processing(CopyFrames), m_settings_changed(false),
+    m_arm_requested(false), m_trigger_armed(true),
+    m_spectrum_settings_changed(false),
+    m_statistics_enabled(false), m_statistics_fresh(false),
+    m_column_channel(0), m_max_columns(1), m_column_bins(0)
+  {}
+
+  enum Processing {
+    CopyFrames,
+    TriggerFrames,
+    AnalyzeSpectrum,
+    SpectrumColumns
+  };
+
+  // Stops polling and waits for the thread to finish.
+  void stopReading()
+  {
+    m_quit = true;
+    wait();
+    m_quit = false;
+  }
+
+  ScopeFrameBuffer & frames() { return m_frames; }
+
+  // The following may be called from any thread, and take effect
+  // before the next frame is read.
+
+  void setProcessing(Processing processing) { m_processing = processing; }
+
+  void setTriggerSettings(const ScopeTriggerSettings &settings)
+  {
+    QMutexLocker locker(&m_settings_mutex);
+    m_pending_settings = settings;
+    m_settings_changed = true;
+  }
+
+  void armTrigger() { m_arm_requested = true; }
+
+  void setSpectrumSettings(const SpectrumSettings &settings)
+  {
+    QMutexLocker locker(&m_settings_mutex);
+    m_pending_spectrum_settings = settings;
+    m_spectrum_settings_changed = true;
+  }
+
+  // Whether a single trigger is still awaited.
+  bool isTriggerArmed() const { return m_trigger_armed; }
+
+  // Whether to compute statistics of every buffer pulled.
+  void setStatisticsEnabled(bool enabled) { m_statistics_enabled = enabled; }
+
+  // Swaps the statistics of the latest buffer into 'out', if there are
+  // any since the last call.
+  bool takeStatistics(std::vector<ScopeChannelStatistics> &out)
+  {
+    if (!m_statistics_fresh.exchange(false))
+      return false;
+    QMutexLocker locker(&m_statistics_mutex);
+    out.swap(m_statistics);
+    return true;
+  }
+
+  // Channel analyzed with SpectrumColumns processing.
+  void setColumnChannel(int channel) { m_column_channel = channel; }
+
+  // Older columns are dropped when more than this are queued.
+  void setMaxColumns(int columns) { m_max_columns = columns; }
+
+  bool hasColumns()
+  {
+    QMutexLocker locker(&m_columns_mutex);
+    return !m_columns.empty();
+  }
+
+  // Replaces the content of 'columns' with the columns queued since
+  // the last call, 'bins' bytes each.
+  void takeColumns(std::vector<unsigned char> &columns, int &bins)
+  {
+    columns.clear();
+    QMutexLocker locker(&m_columns_mutex);
+    // Swapping keeps both buffers allocated.
+    columns.swap(m_columns);
+    bins = m_column_bins;
+  }
+
+protected:
+  void run();
+
+private:
+  void queueColumn(const ScopeFrame &spectrum);
+
+private:
+  OscilloscopeShm *m_shm;
+  std::atomic<bool> m_quit;
+  ScopeFrameBuffer m_frames;
+
+  std::atomic<int> m_processing;
+
+  ScopeTrigger m_trigger;
+  std::atomic<bool> m_settings_changed;
+  std::atomic<bool> m_arm_requested;
+  std::atomic<bool> m_trigger_armed;
+
+  SpectrumAnalyzer m_spectrum;
+  std::atomic<bool> m_spectrum_settings_changed;
+
+  QMutex m_settings_mutex;
+  ScopeTriggerSettings m_pending_settings;
+  SpectrumSettings m_pending_spectrum_settings;
+
+  std::atomic<bool> m_statistics_enabled;
+  std::atomic<bool> m_statistics_fresh;
+  std::vector<ScopeChannelStatistics> m_statistics_work;
+  std::vector<ScopeChannelStatistics> m_statistics;
+  QMutex m_statistics_mutex;
+
+  std::atomic<int> m_column_channel;
+  std::atomic<int> m_max_columns;
+  ScopeFrame m_column_spectrum;
+  std::vector<unsigned char> m_columns;
+  int m_column_bins;
+  QMutex m_columns_mutex;
+};
+
 } // namespace QtCollider
 
 #endif // QC_SCOPE_SHM_INTERFACE_HPP
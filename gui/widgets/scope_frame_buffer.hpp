@@ -0,0 +1,105 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SCOPE_FRAME_BUFFER_INCLUDED
+#define QUICK_COLLIDER_SCOPE_FRAME_BUFFER_INCLUDED
+
+#include <atomic>
+#include <vector>
+
+namespace QuickCollider {
+
+// One complete scope frame, with channels stored one after another.
+
+struct ScopeFrame
+{
+    ScopeFrame(): channels(0), frames(0) {}
+
+    const float * channel( int index ) const { return data.data() + index * frames; }
+    float * channel( int index ) { return data.data() + index * frames; }
+
+    void resize( int channels, int frames )
+    {
+        this->channels = channels;
+        this->frames = frames;
+        // Keeps capacity, so a steady format does not allocate.
+        data.resize( channels * frames );
+    }
+
+    std::vector<float> data;
+    int channels;
+    int frames;
+};
+
+// Lock-free triple buffer for passing scope frames from one writer thread
+// to one reader thread. The writer fills back() and publishes it; the
+// reader picks up the most recently published frame with acquire(),
+// skipping any it did not get to. Neither side ever waits for the other.
+
+class ScopeFrameBuffer
+{
+public:
+    ScopeFrameBuffer(): m_back(0), m_middle(1), m_front(2) {}
+
+    // Writer side
+
+    ScopeFrame & back() { return m_frames[m_back]; }
+
+    void publish()
+    {
+        m_back = m_middle.exchange( m_back | FreshFlag, std::memory_order_acq_rel ) & IndexMask;
+    }
+
+    // Reader side
+
+    bool hasFresh() const
+    {
+        return m_middle.load( std::memory_order_acquire ) & FreshFlag;
+    }
+
+    // Makes the most recently published frame the front(), if there is one
+    // not yet acquired. Returns whether front() changed.
+    bool acquire()
+    {
+        if (!hasFresh())
+            return false;
+        m_front = m_middle.exchange( m_front, std::memory_order_acq_rel ) & IndexMask;
+        return true;
+    }
+
+    const ScopeFrame & front() const { return m_frames[m_front]; }
+
+    // Only while neither side is active.
+    void clear()
+    {
+        for (int idx = 0; idx < 3; ++idx)
+            m_frames[idx].resize(0, 0);
+        m_middle.store( m_middle.load() & IndexMask );
+    }
+
+private:
+    enum { IndexMask = 3, FreshFlag = 4 };
+
+    ScopeFrame m_frames[3];
+    int m_back;
+    std::atomic<int> m_middle;
+    int m_front;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SCOPE_FRAME_BUFFER_INCLUDED
@@ -0,0 +1,592 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scope_kernels.hpp"
+
+#if QC_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace QuickCollider {
+
+namespace {
+
+// Shared by all instruction sets, for splitting frames into min-max columns.
+
+inline int columnEnd( int col, int count, int columns )
+{
+    return (long long) (col + 1) * count / columns;
+}
+
+// Start with the last frame of previous column, so adjacent columns always connect.
+inline int columnStart( int begin )
+{
+    return begin > 0 ? begin - 1 : begin;
+}
+
+// Each column is a vertical segment; alternating its direction makes the
+// line strip connect columns along the envelope edges, so even a flat
+// signal remains visible.
+
+struct VertexWriter
+{
+    static void write( float * xy, int col, int begin, int end, float min, float max )
+    {
+        float x = (begin + end - 1) * 0.5f;
+        bool down = col & 1;
+        float *out = xy + col * 4;
+        out[0] = x;
+        out[1] = down ? max : min;
+        out[2] = x;
+        out[3] = down ? min : max;
+    }
+};
+
+struct ValueWriter
+{
+    static void write( float * values, int col, int, int, float min, float max )
+    {
+        bool down = col & 1;
+        float *out = values + col * 2;
+        out[0] = down ? max : min;
+        out[1] = down ? min : max;
+    }
+};
+
+// Trigger search is composed of searches for the first value passing a comparison.
+
+enum Comparison { Less, LessEqual, Greater, GreaterEqual };
+
+template <int cmp>
+inline bool compare( float value, float threshold )
+{
+    switch (cmp) {
+    case Less: return value < threshold;
+    case LessEqual: return value <= threshold;
+    case Greater: return value > threshold;
+    default: return value >= threshold;
+    }
+}
+
+typedef int (*FindFunction)( const float * data, int count, float threshold );
+
+template <FindFunction less, FindFunction lessEqual,
+          FindFunction greater, FindFunction greaterEqual>
+int findTrigger( const float * data, int count, float level, float hysteresis,
+                 bool rising, bool & armed )
+{
+    if (hysteresis < 0.f)
+        hysteresis = 0.f;
+
+    int idx = 0;
+    if (!armed) {
+        idx += rising ? less( data, count, level - hysteresis )
+                      : greater( data, count, level + hysteresis );
+        if (idx >= count)
+            return -1;
+        armed = true;
+    }
+
+    idx += rising ? greaterEqual( data + idx, count - idx, level )
+                  : lessEqual( data + idx, count - idx, level );
+    if (idx >= count)
+        return -1;
+
+    armed = false;
+    return idx;
+}
+
+// Scalar
+
+template <int cmp>
+int findScalar( const float * data, int count, float threshold )
+{
+    int idx = 0;
+    while (idx < count && !compare<cmp>(data[idx], threshold))
+        ++idx;
+    return idx;
+}
+
+inline void reduceScalar( const float * data, int count, float & min, float & max )
+{
+    for (int idx = 0; idx < count; ++idx) {
+        float value = data[idx];
+        if (value < min) min = value;
+        if (value > max) max = value;
+    }
+}
+
+// Continues sums over data[begin..count), with running values passed by reference.
+inline void continueSums( const float * data, int begin, int count,
+                          float & min, float & max, double & sum, double & sum_sq, int & crossings )
+{
+    for (int idx = begin; idx < count; ++idx) {
+        float value = data[idx];
+        if (value < min) min = value;
+        if (value > max) max = value;
+        sum += value;
+        sum_sq += (double) value * value;
+        if (idx > 0 && (data[idx - 1] < 0.f) != (value < 0.f))
+            ++crossings;
+    }
+}
+
+void sumsScalar( const float * data, int count, ScopeSums & out )
+{
+    float min = data[0], max = data[0];
+    double sum = 0.0, sum_sq = 0.0;
+    int crossings = 0;
+    continueSums( data, 0, count, min, max, sum, sum_sq, crossings );
+    out.min = min;
+    out.max = max;
+    out.sum = sum;
+    out.sum_of_squares = sum_sq;
+    out.zero_crossings = crossings;
+}
+
+void indexedVerticesScalar( const float * y, float * xy, int count )
+{
+    for (int idx = 0; idx < count; ++idx) {
+        xy[idx * 2] = (float) idx;
+        xy[idx * 2 + 1] = y[idx];
+    }
+}
+
+void xyVerticesScalar( const float * x, const float * y, float * xy, int count )
+{
+    for (int idx = 0; idx < count; ++idx) {
+        xy[idx * 2] = x[idx];
+        xy[idx * 2 + 1] = y[idx];
+    }
+}
+
+template <typename Writer>
+void minMaxScalar( const float * data, int count, int columns, float * out )
+{
+    int begin = 0;
+    for (int col = 0; col < columns; ++col)
+    {
+        int end = columnEnd(col, count, columns);
+        int idx = columnStart(begin);
+        float min = data[idx];
+        float max = min;
+        ++idx;
+        reduceScalar( data + idx, end - idx, min, max );
+        Writer::write( out, col, begin, end, min, max );
+        begin = end;
+    }
+}
+
+#if QC_SIMD_X86
+
+// SSE2
+
+QC_TARGET_SSE2
+inline void reduceSse2( const float * data, int count, float & min, float & max )
+{
+    int idx = 0;
+    if (count >= 4)
+    {
+        __m128 vmin = _mm_loadu_ps(data);
+        __m128 vmax = vmin;
+        for (idx = 4; idx + 4 <= count; idx += 4) {
+            __m128 v = _mm_loadu_ps(data + idx);
+            vmin = _mm_min_ps(vmin, v);
+            vmax = _mm_max_ps(vmax, v);
+        }
+        vmin = _mm_min_ps(vmin, _mm_movehl_ps(vmin, vmin));
+        vmin = _mm_min_ss(vmin, _mm_shuffle_ps(vmin, vmin, 1));
+        vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+        vmax = _mm_max_ss(vmax, _mm_shuffle_ps(vmax, vmax, 1));
+        float block_min = _mm_cvtss_f32(vmin);
+        float block_max = _mm_cvtss_f32(vmax);
+        if (block_min < min) min = block_min;
+        if (block_max > max) max = block_max;
+    }
+    reduceScalar( data + idx, count - idx, min, max );
+}
+
+QC_TARGET_SSE2
+void indexedVerticesSse2( const float * y, float * xy, int count )
+{
+    __m128 vx = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    const __m128 step = _mm_set1_ps(4.f);
+    int idx = 0;
+    for (; idx + 4 <= count; idx += 4) {
+        __m128 vy = _mm_loadu_ps(y + idx);
+        _mm_storeu_ps(xy + idx * 2, _mm_unpacklo_ps(vx, vy));
+        _mm_storeu_ps(xy + idx * 2 + 4, _mm_unpackhi_ps(vx, vy));
+        vx = _mm_add_ps(vx, step);
+    }
+    for (; idx < count; ++idx) {
+        xy[idx * 2] = (float) idx;
+        xy[idx * 2 + 1] = y[idx];
+    }
+}
+
+QC_TARGET_SSE2
+void xyVerticesSse2( const float * x, const float * y, float * xy, int count )
+{
+    int idx = 0;
+    for (; idx + 4 <= count; idx += 4) {
+        __m128 vx = _mm_loadu_ps(x + idx);
+        __m128 vy = _mm_loadu_ps(y + idx);
+        _mm_storeu_ps(xy + idx * 2, _mm_unpacklo_ps(vx, vy));
+        _mm_storeu_ps(xy + idx * 2 + 4, _mm_unpackhi_ps(vx, vy));
+    }
+    xyVerticesScalar( x + idx, y + idx, xy + idx * 2, count - idx );
+}
+
+template <typename Writer>
+QC_TARGET_SSE2
+void minMaxSse2( const float * data, int count, int columns, float * out )
+{
+    int begin = 0;
+    for (int col = 0; col < columns; ++col)
+    {
+        int end = columnEnd(col, count, columns);
+        int idx = columnStart(begin);
+        float min = data[idx];
+        float max = min;
+        ++idx;
+        reduceSse2( data + idx, end - idx, min, max );
+        Writer::write( out, col, begin, end, min, max );
+        begin = end;
+    }
+}
+
+template <int cmp>
+QC_TARGET_SSE2
+inline __m128 compareSse2( __m128 value, __m128 threshold )
+{
+    switch (cmp) {
+    case Less: return _mm_cmplt_ps(value, threshold);
+    case LessEqual: return _mm_cmple_ps(value, threshold);
+    case Greater: return _mm_cmpgt_ps(value, threshold);
+    default: return _mm_cmpge_ps(value, threshold);
+    }
+}
+
+// Vector loops start at 1, so each block can compare against the previous
+// value by an unaligned load one value back.
+//
+// Sums are accumulated as doubles, as large buffers lose the precision RMS
+// and DC offset need in floats.
+
+QC_TARGET_SSE2
+inline double horizontalSum( __m128d v )
+{
+    v = _mm_add_sd(v, _mm_unpackhi_pd(v, v));
+    return _mm_cvtsd_f64(v);
+}
+
+// Adds the 4 values of 'v' and their squares to the accumulators, as doubles.
+QC_TARGET_SSE2
+inline void accumulateSse2( __m128 v, __m128d & sum, __m128d & sum_sq )
+{
+    __m128d lo = _mm_cvtps_pd(v);
+    __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+    sum = _mm_add_pd(sum, _mm_add_pd(lo, hi));
+    sum_sq = _mm_add_pd(sum_sq, _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi)));
+}
+
+QC_TARGET_SSE2
+void sumsSse2( const float * data, int count, ScopeSums & out )
+{
+    float min = data[0], max = data[0];
+    double sum = data[0], sum_sq = (double) data[0] * data[0];
+    int crossings = 0;
+    int idx = 1;
+    if (count >= 5)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        __m128 vmin = _mm_set1_ps(min);
+        __m128 vmax = vmin;
+        __m128d vsum = _mm_setzero_pd();
+        __m128d vsum_sq = _mm_setzero_pd();
+        for (; idx + 4 <= count; idx += 4) {
+            __m128 v = _mm_loadu_ps(data + idx);
+            __m128 prev = _mm_loadu_ps(data + idx - 1);
+            vmin = _mm_min_ps(vmin, v);
+            vmax = _mm_max_ps(vmax, v);
+            accumulateSse2(v, vsum, vsum_sq);
+            __m128 sign_change = _mm_xor_ps(_mm_cmplt_ps(v, zero), _mm_cmplt_ps(prev, zero));
+            crossings += __builtin_popcount(_mm_movemask_ps(sign_change));
+        }
+        vmin = _mm_min_ps(vmin, _mm_movehl_ps(vmin, vmin));
+        vmin = _mm_min_ss(vmin, _mm_shuffle_ps(vmin, vmin, 1));
+        vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+        vmax = _mm_max_ss(vmax, _mm_shuffle_ps(vmax, vmax, 1));
+        min = _mm_cvtss_f32(vmin);
+        max = _mm_cvtss_f32(vmax);
+        sum += horizontalSum(vsum);
+        sum_sq += horizontalSum(vsum_sq);
+    }
+    continueSums( data, idx, count, min, max, sum, sum_sq, crossings );
+    out.min = min;
+    out.max = max;
+    out.sum = sum;
+    out.sum_of_squares = sum_sq;
+    out.zero_crossings = crossings;
+}
+
+template <int cmp>
+QC_TARGET_SSE2
+int findSse2( const float * data, int count, float threshold )
+{
+    const __m128 t = _mm_set1_ps(threshold);
+    int idx = 0;
+    for (; idx + 4 <= count; idx += 4) {
+        int mask = _mm_movemask_ps( compareSse2<cmp>(_mm_loadu_ps(data + idx), t) );
+        if (mask)
+            return idx + __builtin_ctz(mask);
+    }
+    return idx + findScalar<cmp>( data + idx, count - idx, threshold );
+}
+
+// AVX2
+
+QC_TARGET_AVX2
+inline void reduceAvx2( const float * data, int count, float & min, float & max )
+{
+    int idx = 0;
+    if (count >= 8)
+    {
+        __m256 vmin8 = _mm256_loadu_ps(data);
+        __m256 vmax8 = vmin8;
+        for (idx = 8; idx + 8 <= count; idx += 8) {
+            __m256 v = _mm256_loadu_ps(data + idx);
+            vmin8 = _mm256_min_ps(vmin8, v);
+            vmax8 = _mm256_max_ps(vmax8, v);
+        }
+        __m128 vmin = _mm_min_ps(_mm256_castps256_ps128(vmin8), _mm256_extractf128_ps(vmin8, 1));
+        __m128 vmax = _mm_max_ps(_mm256_castps256_ps128(vmax8), _mm256_extractf128_ps(vmax8, 1));
+        // columns are often short, so take another 4 before going scalar
+        if (idx + 4 <= count) {
+            __m128 v = _mm_loadu_ps(data + idx);
+            vmin = _mm_min_ps(vmin, v);
+            vmax = _mm_max_ps(vmax, v);
+            idx += 4;
+        }
+        vmin = _mm_min_ps(vmin, _mm_movehl_ps(vmin, vmin));
+        vmin = _mm_min_ss(vmin, _mm_shuffle_ps(vmin, vmin, 1));
+        vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+        vmax = _mm_max_ss(vmax, _mm_shuffle_ps(vmax, vmax, 1));
+        float block_min = _mm_cvtss_f32(vmin);
+        float block_max = _mm_cvtss_f32(vmax);
+        if (block_min < min) min = block_min;
+        if (block_max > max) max = block_max;
+    }
+    reduceScalar( data + idx, count - idx, min, max );
+}
+
+QC_TARGET_AVX2
+void indexedVerticesAvx2( const float * y, float * xy, int count )
+{
+    __m256 vx = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+    const __m256 step = _mm256_set1_ps(8.f);
+    int idx = 0;
+    for (; idx + 8 <= count; idx += 8) {
+        __m256 vy = _mm256_loadu_ps(y + idx);
+        // unpack works within 128-bit lanes, so swap the middle halves afterwards
+        __m256 lo = _mm256_unpacklo_ps(vx, vy);
+        __m256 hi = _mm256_unpackhi_ps(vx, vy);
+        _mm256_storeu_ps(xy + idx * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(xy + idx * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+        vx = _mm256_add_ps(vx, step);
+    }
+    for (; idx < count; ++idx) {
+        xy[idx * 2] = (float) idx;
+        xy[idx * 2 + 1] = y[idx];
+    }
+}
+
+QC_TARGET_AVX2
+void xyVerticesAvx2( const float * x, const float * y, float * xy, int count )
+{
+    int idx = 0;
+    for (; idx + 8 <= count; idx += 8) {
+        __m256 vx = _mm256_loadu_ps(x + idx);
+        __m256 vy = _mm256_loadu_ps(y + idx);
+        __m256 lo = _mm256_unpacklo_ps(vx, vy);
+        __m256 hi = _mm256_unpackhi_ps(vx, vy);
+        _mm256_storeu_ps(xy + idx * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(xy + idx * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    xyVerticesScalar( x + idx, y + idx, xy + idx * 2, count - idx );
+}
+
+template <typename Writer>
+QC_TARGET_AVX2
+void minMaxAvx2( const float * data, int count, int columns, float * out )
+{
+    int begin = 0;
+    for (int col = 0; col < columns; ++col)
+    {
+        int end = columnEnd(col, count, columns);
+        int idx = columnStart(begin);
+        float min = data[idx];
+        float max = min;
+        ++idx;
+        reduceAvx2( data + idx, end - idx, min, max );
+        Writer::write( out, col, begin, end, min, max );
+        begin = end;
+    }
+}
+
+template <int cmp>
+QC_TARGET_AVX2
+inline __m256 compareAvx2( __m256 value, __m256 threshold )
+{
+    // ordered, non-signaling: NaN never matches, as in scalar code
+    switch (cmp) {
+    case Less: return _mm256_cmp_ps(value, threshold, _CMP_LT_OQ);
+    case LessEqual: return _mm256_cmp_ps(value, threshold, _CMP_LE_OQ);
+    case Greater: return _mm256_cmp_ps(value, threshold, _CMP_GT_OQ);
+    default: return _mm256_cmp_ps(value, threshold, _CMP_GE_OQ);
+    }
+}
+
+QC_TARGET_AVX2
+void sumsAvx2( const float * data, int count, ScopeSums & out )
+{
+    float min = data[0], max = data[0];
+    double sum = data[0], sum_sq = (double) data[0] * data[0];
+    int crossings = 0;
+    int idx = 1;
+    if (count >= 9)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 vmin8 = _mm256_set1_ps(min);
+        __m256 vmax8 = vmin8;
+        __m256d vsum4 = _mm256_setzero_pd();
+        __m256d vsum_sq4 = _mm256_setzero_pd();
+        for (; idx + 8 <= count; idx += 8) {
+            __m256 v = _mm256_loadu_ps(data + idx);
+            __m256 prev = _mm256_loadu_ps(data + idx - 1);
+            vmin8 = _mm256_min_ps(vmin8, v);
+            vmax8 = _mm256_max_ps(vmax8, v);
+            __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+            __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+            vsum4 = _mm256_add_pd(vsum4, _mm256_add_pd(lo, hi));
+            vsum_sq4 = _mm256_add_pd(vsum_sq4, _mm256_add_pd(_mm256_mul_pd(lo, lo),
+                                                             _mm256_mul_pd(hi, hi)));
+            __m256 sign_change = _mm256_xor_ps(_mm256_cmp_ps(v, zero, _CMP_LT_OQ),
+                                               _mm256_cmp_ps(prev, zero, _CMP_LT_OQ));
+            crossings += __builtin_popcount(_mm256_movemask_ps(sign_change));
+        }
+        __m128 vmin = _mm_min_ps(_mm256_castps256_ps128(vmin8), _mm256_extractf128_ps(vmin8, 1));
+        __m128 vmax = _mm_max_ps(_mm256_castps256_ps128(vmax8), _mm256_extractf128_ps(vmax8, 1));
+        vmin = _mm_min_ps(vmin, _mm_movehl_ps(vmin, vmin));
+        vmin = _mm_min_ss(vmin, _mm_shuffle_ps(vmin, vmin, 1));
+        vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+        vmax = _mm_max_ss(vmax, _mm_shuffle_ps(vmax, vmax, 1));
+        min = _mm_cvtss_f32(vmin);
+        max = _mm_cvtss_f32(vmax);
+        sum += horizontalSum(_mm_add_pd(_mm256_castpd256_pd128(vsum4),
+                                        _mm256_extractf128_pd(vsum4, 1)));
+        sum_sq += horizontalSum(_mm_add_pd(_mm256_castpd256_pd128(vsum_sq4),
+                                           _mm256_extractf128_pd(vsum_sq4, 1)));
+    }
+    continueSums( data, idx, count, min, max, sum, sum_sq, crossings );
+    out.min = min;
+    out.max = max;
+    out.sum = sum;
+    out.sum_of_squares = sum_sq;
+    out.zero_crossings = crossings;
+}
+
+template <int cmp>
+QC_TARGET_AVX2
+int findAvx2( const float * data, int count, float threshold )
+{
+    const __m256 t = _mm256_set1_ps(threshold);
+    int idx = 0;
+    for (; idx + 8 <= count; idx += 8) {
+        int mask = _mm256_movemask_ps( compareAvx2<cmp>(_mm256_loadu_ps(data + idx), t) );
+        if (mask)
+            return idx + __builtin_ctz(mask);
+    }
+    return idx + findScalar<cmp>( data + idx, count - idx, threshold );
+}
+
+#endif // QC_SIMD_X86
+
+const ScopeKernels scalarKernels = {
+    &indexedVerticesScalar,
+    &xyVerticesScalar,
+    &minMaxScalar<VertexWriter>,
+    &minMaxScalar<ValueWriter>,
+    &findTrigger< &findScalar<Less>, &findScalar<LessEqual>,
+                  &findScalar<Greater>, &findScalar<GreaterEqual> >,
+    &sumsScalar,
+    ScalarInstructions
+};
+
+#if QC_SIMD_X86
+
+const ScopeKernels sse2Kernels = {
+    &indexedVerticesSse2,
+    &xyVerticesSse2,
+    &minMaxSse2<VertexWriter>,
+    &minMaxSse2<ValueWriter>,
+    &findTrigger< &findSse2<Less>, &findSse2<LessEqual>,
+                  &findSse2<Greater>, &findSse2<GreaterEqual> >,
+    &sumsSse2,
+    Sse2Instructions
+};
+
+const ScopeKernels avx2Kernels = {
+    &indexedVerticesAvx2,
+    &xyVerticesAvx2,
+    &minMaxAvx2<VertexWriter>,
+    &minMaxAvx2<ValueWriter>,
+    &findTrigger< &findAvx2<Less>, &findAvx2<LessEqual>,
+                  &findAvx2<Greater>, &findAvx2<GreaterEqual> >,
+    &sumsAvx2,
+    Avx2Instructions
+};
+
+#endif
+
+} // namespace
+
+const ScopeKernels * ScopeKernels::get( InstructionSet isa )
+{
+    if (!cpuSupports(isa))
+        return 0;
+
+    switch (isa)
+    {
+#if QC_SIMD_X86
+    case Sse2Instructions:
+        return &sse2Kernels;
+    case Avx2Instructions:
+        return &avx2Kernels;
+#endif
+    default:
+        return &scalarKernels;
+    }
+}
+
+const ScopeKernels & ScopeKernels::get()
+{
+    static const ScopeKernels * kernels = get( bestInstructionSet() );
+    return *kernels;
+}
+
+} // namespace QuickCollider
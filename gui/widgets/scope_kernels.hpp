@@ -0,0 +1,79 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SCOPE_KERNELS_INCLUDED
+#define QUICK_COLLIDER_SCOPE_KERNELS_INCLUDED
+
+#include "../../utility/cpu_features.hpp"
+
+// NOTE: This file must not depend on Qt, so that it can be built into benchmarks.
+
+namespace QuickCollider {
+
+// Loops turning planar scope data into interleaved (x,y) vertex data,
+// searching it for trigger points and reducing it to statistics.
+// The vertex layout matches QSGGeometry::Point2D.
+
+struct ScopeSums
+{
+    float min;
+    float max;
+    double sum;
+    double sum_of_squares;
+    // Amount of sign changes between successive values (zero counts as positive).
+    int zero_crossings;
+};
+
+struct ScopeKernels
+{
+    // xy[i] = (i, y[i])
+    void (*indexedVertices)( const float * y, float * xy, int count );
+
+    // xy[i] = (x[i], y[i])
+    void (*xyVertices)( const float * x, const float * y, float * xy, int count );
+
+    // Reduces 'count' frames to 'columns' min-max pairs (2 vertices per column),
+    // to be drawn as a line strip. x is the center frame of each column.
+    // Requires count >= columns > 0.
+    void (*minMaxVertices)( const float * data, int count, int columns, float * xy );
+
+    // Like minMaxVertices, but only writes the y values (2 per column).
+    void (*minMaxValues)( const float * data, int count, int columns, float * values );
+
+    // Searches for a level crossing with hysteresis. On a rising slope, the
+    // trigger is 'armed' once a value is below (level - hysteresis), and fires
+    // at the first following value at or above 'level'; a falling slope is the
+    // mirror image. 'armed' carries the state across successive calls.
+    // Returns the index of the trigger, or -1 if there is none.
+    int (*findTrigger)( const float * data, int count, float level, float hysteresis,
+                        bool rising, bool & armed );
+
+    // Reduces 'count' values to their sums. Requires count > 0.
+    void (*sums)( const float * data, int count, ScopeSums & sums );
+
+    InstructionSet isa;
+
+    // Kernels for the best instruction set supported by this CPU.
+    static const ScopeKernels & get();
+
+    // Kernels for a specific instruction set, or 0 if the CPU does not support it.
+    static const ScopeKernels * get( InstructionSet );
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SCOPE_KERNELS_INCLUDED
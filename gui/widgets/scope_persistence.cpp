@@ -0,0 +1,243 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scope_persistence.hpp"
+
+#include <QQuickWindow>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
+
+#include <cmath>
+
+namespace QuickCollider {
+
+namespace {
+
+const char *persistenceVertexShader =
+        "attribute highp vec2 vertex;\n"
+        "uniform highp mat4 matrix;\n"
+        "void main() {\n"
+        "    gl_Position = matrix * vec4(vertex, 0.0, 1.0);\n"
+        "}\n";
+
+const char *persistenceFragmentShader =
+        "uniform lowp vec4 color;\n"
+        "void main() {\n"
+        "    gl_FragColor = color;\n"
+        "}\n";
+
+// Multiplying 8-bit color by a factor close to 1 rounds back to the same
+// value, so without an additional subtraction traces never fade out completely.
+const float minimumFadeStep = 2.f / 255.f;
+
+// Fading continues this many decay times after the last data.
+const float fadeDuration = 6.f;
+
+} // namespace
+
+PersistenceNode::PersistenceNode( QQuickWindow * window ):
+    m_window(window),
+    m_fbo(0),
+    m_program(0),
+    m_vertex_buffer(0),
+    m_texture(0),
+    m_matrix_id(-1),
+    m_color_id(-1),
+    m_decay_time(0.5f)
+{
+    setTextureCoordinatesTransform(QSGSimpleTextureNode::MirrorVertically);
+
+    connect(window, SIGNAL(beforeRendering()), this, SLOT(render()), Qt::DirectConnection);
+}
+
+PersistenceNode::~PersistenceNode()
+{
+    delete m_texture;
+    delete m_fbo;
+    delete m_program;
+    delete m_vertex_buffer;
+}
+
+void PersistenceNode::setTextureSize( const QSize & size )
+{
+    if (size == m_texture_size || size.isEmpty())
+        return;
+
+    m_texture_size = size;
+
+    delete m_texture;
+    delete m_fbo;
+
+    m_fbo = new QOpenGLFramebufferObject(size);
+    m_fbo->bind();
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    gl->glClearColor(0, 0, 0, 0);
+    gl->glClear(GL_COLOR_BUFFER_BIT);
+    m_fbo->release();
+
+    m_texture = m_window->createTextureFromId(m_fbo->texture(), size,
+                                              QQuickWindow::TextureHasAlphaChannel);
+    setTexture(m_texture);
+
+    m_frame_clock.invalidate();
+}
+
+float * PersistenceNode::addStrip( int count, const QMatrix4x4 & transform, const QColor & color )
+{
+    Strip strip;
+    strip.start = m_vertices.size() / 2;
+    strip.count = count;
+    strip.transform = transform;
+    strip.color = color;
+    m_strips.push_back(strip);
+
+    m_vertices.resize( m_vertices.size() + count * 2 );
+
+    markDirty(QSGNode::DirtyMaterial);
+
+    return &m_vertices[strip.start * 2];
+}
+
+void PersistenceNode::createProgram()
+{
+    m_program = new QOpenGLShaderProgram;
+    m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, persistenceVertexShader);
+    m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, persistenceFragmentShader);
+    m_program->bindAttributeLocation("vertex", 0);
+    m_program->link();
+    m_matrix_id = m_program->uniformLocation("matrix");
+    m_color_id = m_program->uniformLocation("color");
+
+    m_vertex_buffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    m_vertex_buffer->setUsagePattern(QOpenGLBuffer::StreamDraw);
+    m_vertex_buffer->create();
+}
+
+void PersistenceNode::fade( float factor )
+{
+    static const GLfloat quad[] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+
+    m_vertex_buffer->bind();
+    m_vertex_buffer->allocate(quad, sizeof(quad));
+    gl->glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+    m_program->setUniformValue(m_matrix_id, QMatrix4x4());
+
+    // destination *= factor
+    gl->glBlendEquation(GL_FUNC_ADD);
+    gl->glBlendFunc(GL_ZERO, GL_SRC_ALPHA);
+    m_program->setUniformValue(m_color_id, QVector4D(0, 0, 0, factor));
+    gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    // destination -= step
+    float step = qMin(1.f - factor, minimumFadeStep);
+    gl->glBlendEquation(GL_FUNC_REVERSE_SUBTRACT);
+    gl->glBlendFunc(GL_ONE, GL_ONE);
+    m_program->setUniformValue(m_color_id, QVector4D(step, step, step, step));
+    gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    gl->glBlendEquation(GL_FUNC_ADD);
+}
+
+void PersistenceNode::render()
+{
+    if (!m_fbo)
+        return;
+
+    bool has_data = !m_strips.empty();
+    if (has_data)
+        m_data_clock.start();
+
+    bool fading = m_data_clock.isValid()
+            && m_data_clock.elapsed() < fadeDuration * m_decay_time * 1000.f;
+
+    if (!has_data && !fading)
+        return;
+
+    float elapsed = m_frame_clock.isValid() ? m_frame_clock.restart() * 0.001f : 0.f;
+    if (!m_frame_clock.isValid())
+        m_frame_clock.start();
+
+    if (!m_program)
+        createProgram();
+
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+
+    m_fbo->bind();
+    gl->glViewport(0, 0, m_texture_size.width(), m_texture_size.height());
+    gl->glDisable(GL_DEPTH_TEST);
+    gl->glDisable(GL_STENCIL_TEST);
+    gl->glDisable(GL_SCISSOR_TEST);
+    gl->glEnable(GL_BLEND);
+
+    m_program->bind();
+    m_program->enableAttributeArray(0);
+
+    if (elapsed > 0.f) {
+        float factor = m_decay_time > 0.f ? std::exp(-elapsed / m_decay_time) : 0.f;
+        fade(factor);
+    }
+
+    if (has_data)
+    {
+        // Vertex coordinates are in item space; 'rect' maps it to the texture.
+        QRectF area = rect();
+        QMatrix4x4 projection;
+        projection.ortho(area.left(), area.right(), area.bottom(), area.top(), -1, 1);
+
+        m_vertex_buffer->bind();
+        m_vertex_buffer->allocate(m_vertices.data(), m_vertices.size() * sizeof(float));
+        gl->glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+        // Traces add up, so frequently visited places become brighter.
+        gl->glBlendFunc(GL_ONE, GL_ONE);
+
+        for (size_t idx = 0; idx < m_strips.size(); ++idx)
+        {
+            const Strip & strip = m_strips[idx];
+            const QColor & c = strip.color;
+            float alpha = c.alphaF();
+            m_program->setUniformValue(m_matrix_id, projection * strip.transform);
+            m_program->setUniformValue(m_color_id, QVector4D(c.redF() * alpha, c.greenF() * alpha,
+                                                             c.blueF() * alpha, alpha));
+            gl->glDrawArrays(GL_LINE_STRIP, strip.start, strip.count);
+        }
+
+        m_strips.clear();
+        m_vertices.clear();
+    }
+
+    m_program->disableAttributeArray(0);
+    m_vertex_buffer->release();
+    m_program->release();
+    m_fbo->release();
+
+    m_window->resetOpenGLState();
+
+    // Keep rendering frames until faded out.
+    if (fading || has_data) {
+        markDirty(QSGNode::DirtyMaterial);
+        m_window->update();
+    }
+}
+
+} // namespace QuickCollider
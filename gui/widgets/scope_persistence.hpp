@@ -0,0 +1,95 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SCOPE_PERSISTENCE_INCLUDED
+#define QUICK_COLLIDER_SCOPE_PERSISTENCE_INCLUDED
+
+#include <QObject>
+#include <QSGSimpleTextureNode>
+#include <QMatrix4x4>
+#include <QColor>
+#include <QElapsedTimer>
+#include <QSize>
+
+#include <vector>
+
+class QQuickWindow;
+class QOpenGLFramebufferObject;
+class QOpenGLShaderProgram;
+class QOpenGLBuffer;
+
+namespace QuickCollider {
+
+// Phosphor-like scope display: traces are added onto an offscreen texture,
+// which fades out over time, and the texture is shown on screen. Old traces
+// thus remain visible without being kept or redrawn.
+//
+// Drawing into the texture happens before the window renders each frame.
+
+class PersistenceNode : public QObject, public QSGSimpleTextureNode
+{
+    Q_OBJECT
+
+public:
+    PersistenceNode( QQuickWindow * window );
+    ~PersistenceNode();
+
+    // Size of the texture in pixels; changing it clears the content.
+    void setTextureSize( const QSize & size );
+
+    // Seconds for the brightness to fall to about 1/3 (1/e).
+    void setDecayTime( float seconds ) { m_decay_time = seconds; }
+
+    // Queues a line strip of 'count' (x,y) vertices, to be added in the next
+    // frame. Returns where to write the vertices, valid until the next call.
+    float * addStrip( int count, const QMatrix4x4 & transform, const QColor & color );
+
+private Q_SLOTS:
+    void render();
+
+private:
+    struct Strip
+    {
+        int start;
+        int count;
+        QMatrix4x4 transform;
+        QColor color;
+    };
+
+    void createProgram();
+    void fade( float factor );
+
+    QQuickWindow *m_window;
+    QOpenGLFramebufferObject *m_fbo;
+    QOpenGLShaderProgram *m_program;
+    QOpenGLBuffer *m_vertex_buffer;
+    QSGTexture *m_texture;
+    QSize m_texture_size;
+    int m_matrix_id;
+    int m_color_id;
+
+    float m_decay_time;
+    QElapsedTimer m_frame_clock;
+    QElapsedTimer m_data_clock;
+
+    std::vector<float> m_vertices;
+    std::vector<Strip> m_strips;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SCOPE_PERSISTENCE_INCLUDED
@@ -0,0 +1,234 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scope_spectrum.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace QuickCollider {
+
+namespace {
+
+const double pi = 3.14159265358979323846;
+
+// Largest analyzed amount of frames.
+const int maxFftSize = 16384;
+
+// Plain complex multiplication; std::complex guards against NaN and infinity,
+// which is much slower and not needed here.
+inline std::complex<float> multiply( const std::complex<float> & a, const std::complex<float> & b )
+{
+    return std::complex<float>( a.real() * b.real() - a.imag() * b.imag(),
+                                a.real() * b.imag() + a.imag() * b.real() );
+}
+
+} // namespace
+
+void RealFft::setSize( int size )
+{
+    if (size == m_size)
+        return;
+
+    m_size = size;
+
+    int half = size / 2;
+
+    m_buffer.resize(half);
+
+    m_bit_reverse.resize(half);
+    int bits = 0;
+    while ((1 << bits) < half)
+        ++bits;
+    for (int idx = 0; idx < half; ++idx) {
+        int reversed = 0;
+        for (int bit = 0; bit < bits; ++bit)
+            if (idx & (1 << bit))
+                reversed |= 1 << (bits - 1 - bit);
+        m_bit_reverse[idx] = reversed;
+    }
+
+    m_twiddles.resize(half / 2);
+    for (int idx = 0; idx < half / 2; ++idx)
+        m_twiddles[idx] = std::polar(1.0, -2.0 * pi * idx / half);
+
+    m_post_twiddles.resize(half);
+    for (int idx = 0; idx < half; ++idx)
+        m_post_twiddles[idx] = std::polar(1.0, -2.0 * pi * idx / size);
+}
+
+void RealFft::powerSpectrum( const float * data, float * power )
+{
+    const int half = m_size / 2;
+    Complex *buffer = m_buffer.data();
+
+    // Pack even and odd samples as real and imaginary parts.
+    for (int idx = 0; idx < half; ++idx)
+        buffer[m_bit_reverse[idx]] = Complex(data[idx * 2], data[idx * 2 + 1]);
+
+    for (int length = 2; length <= half; length *= 2)
+    {
+        int span = length / 2;
+        int step = half / length;
+        for (int start = 0; start < half; start += length) {
+            for (int idx = 0; idx < span; ++idx) {
+                Complex a = buffer[start + idx];
+                Complex b = multiply( m_twiddles[idx * step], buffer[start + idx + span] );
+                buffer[start + idx] = a + b;
+                buffer[start + idx + span] = a - b;
+            }
+        }
+    }
+
+    // Separate the spectra of even and odd samples, and combine them.
+    float dc = buffer[0].real() + buffer[0].imag();
+    float nyquist = buffer[0].real() - buffer[0].imag();
+    power[0] = dc * dc;
+    power[half] = nyquist * nyquist;
+
+    for (int idx = 1; idx < half; ++idx)
+    {
+        Complex z = buffer[idx];
+        Complex z_mirror = std::conj(buffer[half - idx]);
+        Complex even = (z + z_mirror) * 0.5f;
+        Complex odd = multiply( z - z_mirror, Complex(0.f, -0.5f) );
+        Complex x = even + multiply( m_post_twiddles[idx], odd );
+        power[idx] = x.real() * x.real() + x.imag() * x.imag();
+    }
+}
+
+void SpectrumAnalyzer::setSettings( const SpectrumSettings & settings )
+{
+    SpectrumSettings s = settings;
+    s.bins = std::max(2, std::min(s.bins, 4096));
+    s.averaging = std::max(0.f, std::min(s.averaging, 0.999f));
+    s.range = std::max(1.f, s.range);
+
+    bool rebuild = s.bins != m_settings.bins;
+
+    m_settings = s;
+
+    if (rebuild)
+        reset();
+}
+
+void SpectrumAnalyzer::reset()
+{
+    // Forces preparation on next frame.
+    m_fft.setSize(0);
+    m_averages.clear();
+}
+
+void SpectrumAnalyzer::prepare( int size )
+{
+    m_fft.setSize(size);
+
+    // Periodic Hann window
+    m_window.resize(size);
+    double window_sum = 0.0;
+    for (int idx = 0; idx < size; ++idx) {
+        m_window[idx] = 0.5 - 0.5 * std::cos(2.0 * pi * idx / size);
+        window_sum += m_window[idx];
+    }
+    // A full scale sine wave results in 0 dB.
+    m_normalization = (float) std::pow(2.0 / window_sum, 2.0);
+
+    m_input.resize(size);
+    m_power.resize(size / 2 + 1);
+
+    // Logarithmically spaced bands from the first FFT bin to Nyquist.
+    int half = size / 2;
+    int bins = m_settings.bins;
+    m_bands.resize(bins);
+    for (int band = 0; band < bins; ++band)
+    {
+        double lo = std::pow((double) half, (double) band / bins);
+        double hi = std::pow((double) half, (double) (band + 1) / bins);
+        Band & b = m_bands[band];
+        b.start = (int) std::ceil(lo);
+        b.end = band == bins - 1 ? half + 1 : (int) std::ceil(hi);
+        b.position = (float) std::sqrt(lo * hi);
+    }
+
+    m_averages.assign(m_channels * bins, 0.f);
+}
+
+bool SpectrumAnalyzer::process( const float * data, int channels, int frames, int stride,
+                                ScopeFrame & out )
+{
+    if (channels < 1 || frames < 4)
+        return false;
+
+    int size = 4;
+    while (size * 2 <= std::min(frames, maxFftSize))
+        size *= 2;
+
+    int bins = m_settings.bins;
+
+    if (channels != m_channels) {
+        m_channels = channels;
+        m_averages.clear();
+    }
+
+    if (size != m_fft.size() || (int) m_averages.size() != channels * bins)
+        prepare(size);
+
+    const int half = size / 2;
+    const float weight = m_settings.averaging;
+    const float range = m_settings.range;
+
+    out.resize(channels, bins);
+
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        const float *input = data + ch * stride + frames - size;
+        for (int idx = 0; idx < size; ++idx)
+            m_input[idx] = input[idx] * m_window[idx];
+
+        m_fft.powerSpectrum( m_input.data(), m_power.data() );
+
+        float *averages = &m_averages[ch * bins];
+        float *output = out.channel(ch);
+
+        for (int band = 0; band < bins; ++band)
+        {
+            const Band & b = m_bands[band];
+            float power;
+            if (b.end > b.start) {
+                // Peaks remain visible when many bins fall into one band.
+                power = *std::max_element( &m_power[b.start], &m_power[b.end] );
+            } else {
+                int idx = (int) b.position;
+                float fraction = b.position - idx;
+                float next = m_power[std::min(idx + 1, half)];
+                power = m_power[idx] + (next - m_power[idx]) * fraction;
+            }
+            power *= m_normalization;
+
+            float & average = averages[band];
+            average = weight * average + (1.f - weight) * power;
+
+            float db = 10.f * std::log10(average + 1e-20f);
+            float value = 1.f + 2.f * db / range;
+            output[band] = std::max(-1.f, std::min(value, 1.f));
+        }
+    }
+
+    return true;
+}
+
+} // namespace QuickCollider
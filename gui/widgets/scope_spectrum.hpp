@@ -0,0 +1,114 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SCOPE_SPECTRUM_INCLUDED
+#define QUICK_COLLIDER_SCOPE_SPECTRUM_INCLUDED
+
+#include "scope_frame_buffer.hpp"
+
+#include <complex>
+#include <vector>
+
+namespace QuickCollider {
+
+// Radix-2 FFT of real data, computed as a complex FFT of half the size.
+
+class RealFft
+{
+public:
+    RealFft(): m_size(0) {}
+
+    // 'size' must be a power of two, at least 4.
+    void setSize( int size );
+    int size() const { return m_size; }
+
+    // Writes size() / 2 + 1 squared magnitudes, from DC to Nyquist.
+    void powerSpectrum( const float * data, float * power );
+
+private:
+    typedef std::complex<float> Complex;
+
+    int m_size;
+    std::vector<Complex> m_buffer;
+    std::vector<Complex> m_twiddles;
+    std::vector<Complex> m_post_twiddles;
+    std::vector<int> m_bit_reverse;
+};
+
+struct SpectrumSettings
+{
+    SpectrumSettings():
+        bins(256),
+        averaging(0.5f),
+        range(90.f)
+    {}
+
+    // Amount of logarithmically spaced frequency bands.
+    int bins;
+    // Weight of the previous average, from 0 (none) to 1 (frozen).
+    float averaging;
+    // Displayed decibels below full scale.
+    float range;
+};
+
+// Turns scope frames into log-frequency magnitude spectra, one per channel.
+//
+// The sample rate is not known to the scope, so bands range from the
+// lowest analyzed frequency to Nyquist. Output values map -range...0 dB
+// to -1...1, to be shown like any other scope track.
+
+class SpectrumAnalyzer
+{
+public:
+    SpectrumAnalyzer(): m_channels(0) {}
+
+    void setSettings( const SpectrumSettings & settings );
+    const SpectrumSettings & settings() const { return m_settings; }
+
+    // Forgets the averages.
+    void reset();
+
+    // Analyzes the latest power-of-two amount of frames of each channel,
+    // 'stride' apart. Returns whether 'out' received spectra.
+    bool process( const float * data, int channels, int frames, int stride,
+                  ScopeFrame & out );
+
+private:
+    struct Band
+    {
+        // FFT bins [start, end) if not empty, else an interpolated position.
+        int start;
+        int end;
+        float position;
+    };
+
+    void prepare( int size );
+
+    SpectrumSettings m_settings;
+    RealFft m_fft;
+    std::vector<float> m_window;
+    float m_normalization;
+    std::vector<Band> m_bands;
+    std::vector<float> m_input;
+    std::vector<float> m_power;
+    std::vector<float> m_averages;
+    int m_channels;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SCOPE_SPECTRUM_INCLUDED
@@ -0,0 +1,47 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scope_statistics.hpp"
+#include "scope_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace QuickCollider {
+
+void computeScopeStatistics( const float * data, int channels, int frames, int stride,
+                             std::vector<ScopeChannelStatistics> & out )
+{
+    const ScopeKernels & kernels = ScopeKernels::get();
+
+    out.resize(channels);
+
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        ScopeSums sums;
+        kernels.sums( data + ch * stride, frames, sums );
+
+        ScopeChannelStatistics & stats = out[ch];
+        stats.peak = std::max( std::fabs(sums.min), std::fabs(sums.max) );
+        stats.rms = (float) std::sqrt( std::max(0.0, sums.sum_of_squares) / frames );
+        stats.dc = (float) (sums.sum / frames);
+        stats.crest = stats.rms > 0.f ? stats.peak / stats.rms : 0.f;
+        stats.zero_crossing_rate = frames > 1 ? (float) sums.zero_crossings / (frames - 1) : 0.f;
+    }
+}
+
+} // namespace QuickCollider
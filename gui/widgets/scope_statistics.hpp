@@ -0,0 +1,45 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SCOPE_STATISTICS_INCLUDED
+#define QUICK_COLLIDER_SCOPE_STATISTICS_INCLUDED
+
+#include <vector>
+
+namespace QuickCollider {
+
+struct ScopeChannelStatistics
+{
+    // Largest absolute value
+    float peak;
+    float rms;
+    // Mean value
+    float dc;
+    // peak / rms, or 0 for silence
+    float crest;
+    // Sign changes per frame; multiply by the sample rate for crossings per second.
+    float zero_crossing_rate;
+};
+
+// Computes statistics of each channel of a scope buffer,
+// with channels 'stride' apart. Requires frames > 0.
+void computeScopeStatistics( const float * data, int channels, int frames, int stride,
+                             std::vector<ScopeChannelStatistics> & out );
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SCOPE_STATISTICS_INCLUDED
@@ -0,0 +1,369 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scope_trace.hpp"
+#include "scope_kernels.hpp"
+#include "geometry_capacity.hpp"
+
+#include <QSGMaterialShader>
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QByteArray>
+#include <QVector>
+
+#include <algorithm>
+#include <cstring>
+
+namespace QuickCollider {
+
+namespace {
+
+const char *traceVertexShader =
+        "in float value;\n"
+        "uniform highp mat4 qt_Matrix;\n"
+        "uniform float xOffset;\n"
+        "uniform float xScale;\n"
+        "uniform float yBase;\n"
+        "uniform float yStep;\n"
+        "uniform float yScale;\n"
+        "uniform int frames;\n"
+        "uniform int columns;\n"
+        "uniform int stride;\n"
+        "uniform int channels;\n"
+        "uniform int paletteSize;\n"
+        "uniform lowp vec4 palette[MAX_PALETTE_SIZE];\n"
+        "out lowp vec4 vColor;\n"
+        "out float vVisible;\n"
+        "void main() {\n"
+        "    int channel = gl_VertexID / stride;\n"
+        "    int idx = gl_VertexID - channel * stride;\n"
+        "    int count = stride - 2;\n"
+        "    vVisible = 1.0;\n"
+        // spare capacity beyond the last channel
+        "    if (channel >= channels) {\n"
+        "        vVisible = 0.0;\n"
+        "        channel = channels;\n"
+        "        idx = 0;\n"
+        "    }\n"
+        // bridging vertices: same place as last vertex of this channel,
+        // and first vertex of next one
+        "    if (idx >= count) {\n"
+        "        vVisible = 0.0;\n"
+        "        if (idx == count) {\n"
+        "            idx = count - 1;\n"
+        "        } else {\n"
+        "            idx = 0;\n"
+        "            channel += 1;\n"
+        "        }\n"
+        "    }\n"
+        "    float frame;\n"
+        "    if (columns > 0) {\n"
+        // same columns as ScopeKernels::minMaxValues
+        "        int col = idx / 2;\n"
+        "        int begin = col * frames / columns;\n"
+        "        int end = (col + 1) * frames / columns;\n"
+        "        frame = float(begin + end - 1) * 0.5;\n"
+        "    } else {\n"
+        "        frame = float(idx);\n"
+        "    }\n"
+        "    vColor = palette[channel - (channel / paletteSize) * paletteSize];\n"
+        "    vec2 pos = vec2((frame - xOffset) * xScale,\n"
+        "                    yBase + float(channel) * yStep - value * yScale);\n"
+        "    gl_Position = qt_Matrix * vec4(pos, 0.0, 1.0);\n"
+        "}\n";
+
+const char *traceFragmentShader =
+        "in lowp vec4 vColor;\n"
+        "in float vVisible;\n"
+        "uniform lowp float qt_Opacity;\n"
+        "out lowp vec4 fragColor;\n"
+        "void main() {\n"
+        "    if (vVisible < 0.5)\n"
+        "        discard;\n"
+        "    fragColor = vColor * qt_Opacity;\n"
+        "}\n";
+
+QByteArray shaderHeader( bool fragment )
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    QSurfaceFormat format = context->format();
+    if (format.renderableType() == QSurfaceFormat::OpenGLES) {
+        QByteArray header("#version 300 es\n");
+        if (fragment)
+            header += "precision mediump float;\n";
+        return header;
+    }
+    if (format.version() >= qMakePair(3, 2))
+        return "#version 150\n";
+    return "#version 130\n";
+}
+
+const QSGGeometry::AttributeSet & valueAttributes()
+{
+    static QSGGeometry::Attribute attribute =
+            QSGGeometry::Attribute::create(0, 1, GL_FLOAT, true);
+    static QSGGeometry::AttributeSet attributes = { 1, sizeof(float), &attribute };
+    return attributes;
+}
+
+} // namespace
+
+class ScopeTraceShader : public QSGMaterialShader
+{
+public:
+    ScopeTraceShader():
+        m_vertex_shader( shaderHeader(false)
+                         + "#define MAX_PALETTE_SIZE "
+                         + QByteArray::number(ScopeTraceMaterial::MaxPaletteSize) + "\n"
+                         + traceVertexShader ),
+        m_fragment_shader( shaderHeader(true) + traceFragmentShader )
+    {}
+
+    const char *vertexShader() const { return m_vertex_shader.constData(); }
+    const char *fragmentShader() const { return m_fragment_shader.constData(); }
+
+    char const *const *attributeNames() const
+    {
+        static char const *const names[] = { "value", 0 };
+        return names;
+    }
+
+    void updateState( const RenderState & state, QSGMaterial * newMaterial, QSGMaterial * )
+    {
+        QOpenGLShaderProgram *p = program();
+
+        if (state.isMatrixDirty())
+            p->setUniformValue(m_matrix_id, state.combinedMatrix());
+        if (state.isOpacityDirty())
+            p->setUniformValue(m_opacity_id, state.opacity());
+
+        ScopeTraceMaterial *m = static_cast<ScopeTraceMaterial*>(newMaterial);
+        p->setUniformValue(m_x_offset_id, m->xOffset);
+        p->setUniformValue(m_x_scale_id, m->xScale);
+        p->setUniformValue(m_y_base_id, m->yBase);
+        p->setUniformValue(m_y_step_id, m->yStep);
+        p->setUniformValue(m_y_scale_id, m->yScale);
+        p->setUniformValue(m_frames_id, m->frames);
+        p->setUniformValue(m_columns_id, m->columns);
+        p->setUniformValue(m_stride_id, qMax(3, m->stride));
+        p->setUniformValue(m_channels_id, m->channels);
+
+        // premultiplied alpha, as everywhere in the scene graph
+        const QVector<QColor> & palette = m->palette();
+        Q_ASSERT(palette.size() <= ScopeTraceMaterial::MaxPaletteSize);
+        GLfloat colors[ScopeTraceMaterial::MaxPaletteSize * 4];
+        for (int idx = 0; idx < palette.size(); ++idx) {
+            const QColor & c = palette[idx];
+            float alpha = c.alphaF();
+            colors[idx * 4] = c.redF() * alpha;
+            colors[idx * 4 + 1] = c.greenF() * alpha;
+            colors[idx * 4 + 2] = c.blueF() * alpha;
+            colors[idx * 4 + 3] = alpha;
+        }
+        p->setUniformValue(m_palette_size_id, qMax(1, palette.size()));
+        if (palette.size())
+            p->setUniformValueArray(m_palette_id, colors, palette.size(), 4);
+    }
+
+protected:
+    void initialize()
+    {
+        QOpenGLShaderProgram *p = program();
+        m_matrix_id = p->uniformLocation("qt_Matrix");
+        m_opacity_id = p->uniformLocation("qt_Opacity");
+        m_x_offset_id = p->uniformLocation("xOffset");
+        m_x_scale_id = p->uniformLocation("xScale");
+        m_y_base_id = p->uniformLocation("yBase");
+        m_y_step_id = p->uniformLocation("yStep");
+        m_y_scale_id = p->uniformLocation("yScale");
+        m_frames_id = p->uniformLocation("frames");
+        m_columns_id = p->uniformLocation("columns");
+        m_stride_id = p->uniformLocation("stride");
+        m_channels_id = p->uniformLocation("channels");
+        m_palette_size_id = p->uniformLocation("paletteSize");
+        m_palette_id = p->uniformLocation("palette");
+    }
+
+private:
+    QByteArray m_vertex_shader;
+    QByteArray m_fragment_shader;
+    int m_matrix_id;
+    int m_opacity_id;
+    int m_x_offset_id;
+    int m_x_scale_id;
+    int m_y_base_id;
+    int m_y_step_id;
+    int m_y_scale_id;
+    int m_frames_id;
+    int m_columns_id;
+    int m_stride_id;
+    int m_channels_id;
+    int m_palette_size_id;
+    int m_palette_id;
+};
+
+ScopeTraceMaterial::ScopeTraceMaterial():
+    xOffset(0.f),
+    xScale(1.f),
+    yBase(0.f),
+    yStep(0.f),
+    yScale(1.f),
+    frames(0),
+    columns(0),
+    stride(0),
+    channels(0)
+{
+    // x is derived from gl_VertexID, so this geometry must never be merged
+    // into a batch with other geometry.
+    setFlag(RequiresFullMatrix);
+}
+
+bool ScopeTraceMaterial::isSupported()
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    return context && context->format().majorVersion() >= 3;
+}
+
+QSGMaterialType *ScopeTraceMaterial::type() const
+{
+    static QSGMaterialType type;
+    return &type;
+}
+
+QSGMaterialShader *ScopeTraceMaterial::createShader() const
+{
+    return new ScopeTraceShader;
+}
+
+int ScopeTraceMaterial::compare( const QSGMaterial * other ) const
+{
+    // Every scope has its own uniforms; only identical ones are equal.
+    const ScopeTraceMaterial *m = static_cast<const ScopeTraceMaterial*>(other);
+    if (m == this)
+        return 0;
+    return this < m ? -1 : 1;
+}
+
+void ScopeTraceMaterial::setPaletteSize( int size )
+{
+    m_palette.resize( qBound(0, size, (int) MaxPaletteSize) );
+    updateBlending();
+}
+
+void ScopeTraceMaterial::setPaletteColor( int index, const QColor & color )
+{
+    if (index < 0 || index >= m_palette.size())
+        return;
+    m_palette[index] = color;
+    updateBlending();
+}
+
+void ScopeTraceMaterial::updateBlending()
+{
+    bool blending = false;
+    foreach (const QColor & color, m_palette)
+        blending = blending || color.alpha() != 255;
+    setFlag(Blending, blending);
+}
+
+ScopeTraceNode::ScopeTraceNode():
+    m_geometry(valueAttributes(), 0),
+    m_channels(0)
+{
+    m_geometry.setDrawingMode(GL_LINE_STRIP);
+    m_geometry.setLineWidth(1);
+    m_geometry.setVertexDataPattern(QSGGeometry::StreamPattern);
+
+    setGeometry(&m_geometry);
+    setMaterial(&m_material);
+}
+
+void ScopeTraceNode::setFormat( int channels, int frames, int columns )
+{
+    if (channels == m_channels
+            && frames == m_material.frames
+            && columns == m_material.columns)
+        return;
+
+    int count = columns > 0 ? columns * 2 : frames;
+    int stride = count + 2;
+
+    // Vertices beyond the last channel are hidden by the shader, so the
+    // vertex data only needs reallocating when the traces outgrow it.
+    int used = channels * stride;
+    reserveLineStrip(m_geometry, used);
+    int capacity = m_geometry.vertexCount();
+    float *values = static_cast<float*>( m_geometry.vertexData() );
+    std::fill( values + used, values + capacity, 0.f );
+
+    if (channels != m_channels)
+        m_material.setPaletteSize( channels );
+
+    m_channels = channels;
+    m_material.frames = frames;
+    m_material.columns = columns;
+    m_material.stride = stride;
+    m_material.channels = channels;
+
+    markDirty(QSGNode::DirtyGeometry | QSGNode::DirtyMaterial);
+}
+
+void ScopeTraceNode::setChannelData( int channel, const float * data )
+{
+    Q_ASSERT(channel >= 0 && channel < m_channels);
+
+    int stride = m_material.stride;
+    int count = stride - 2;
+    if (count < 1)
+        return;
+
+    float *values = static_cast<float*>( m_geometry.vertexData() ) + channel * stride;
+
+    if (m_material.columns > 0)
+        ScopeKernels::get().minMaxValues( data, m_material.frames, m_material.columns, values );
+    else
+        std::memcpy( values, data, count * sizeof(float) );
+
+    // Bridging vertices: the shader places them onto the last vertex of this
+    // channel and the first vertex of the next one, so they must have the
+    // same values.
+    values[count] = values[count - 1];
+    values[count + 1] = values[count - 1];
+    if (channel > 0)
+        values[-1] = values[0];
+
+    markDirty(QSGNode::DirtyGeometry);
+}
+
+void ScopeTraceNode::setChannelColor( int channel, const QColor & color )
+{
+    m_material.setPaletteColor(channel, color);
+    markDirty(QSGNode::DirtyMaterial);
+}
+
+void ScopeTraceNode::setPlacement( float xOffset, float xScale,
+                                   float yBase, float yStep, float yScale )
+{
+    m_material.xOffset = xOffset;
+    m_material.xScale = xScale;
+    m_material.yBase = yBase;
+    m_material.yStep = yStep;
+    m_material.yScale = yScale;
+    markDirty(QSGNode::DirtyMaterial);
+}
+
+} // namespace QuickCollider
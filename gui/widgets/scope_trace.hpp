@@ -0,0 +1,110 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SCOPE_TRACE_INCLUDED
+#define QUICK_COLLIDER_SCOPE_TRACE_INCLUDED
+
+#include <QSGGeometryNode>
+#include <QSGGeometry>
+#include <QSGMaterial>
+#include <QColor>
+#include <QVector>
+
+namespace QuickCollider {
+
+// Scope trace geometry only holds the sample values (one float per vertex).
+// The shader derives x and the channel from the vertex index, and applies
+// offset, zoom and channel placement as uniforms, so these can change without
+// re-uploading geometry.
+//
+// All channels are packed into one geometry and drawn with a single call:
+// each channel is a separate strip, followed by two invisible vertices that
+// bridge to the next channel. Channel colors come from a palette uniform.
+//
+// Requires gl_VertexID (OpenGL 3.0 or OpenGL ES 3.0); see isSupported().
+
+class ScopeTraceMaterial : public QSGMaterial
+{
+public:
+    // Size of the palette uniform array of the shader, which all materials
+    // share. It stays well within the 256 uniform vectors that any OpenGL ES
+    // 3.0 implementation provides; channels beyond it repeat its colors.
+    enum { MaxPaletteSize = 64 };
+
+    ScopeTraceMaterial();
+
+    // Whether the current OpenGL context can run the shader.
+    static bool isSupported();
+
+    QSGMaterialType *type() const;
+    QSGMaterialShader *createShader() const;
+    int compare( const QSGMaterial * other ) const;
+
+    // Channels use palette colors in turn.
+    const QVector<QColor> & palette() const { return m_palette; }
+    // At most MaxPaletteSize; larger sizes are clamped, and colors set
+    // beyond it are ignored.
+    void setPaletteSize( int size );
+    void setPaletteColor( int index, const QColor & color );
+
+    // x = (frame - xOffset) * xScale
+    // y = yBase + channel * yStep - value * yScale
+    float xOffset;
+    float xScale;
+    float yBase;
+    float yStep;
+    float yScale;
+
+    // When 'columns' > 0, each pair of vertices is the min-max span
+    // of one column of 'frames', as produced by ScopeKernels::minMaxValues.
+    int frames;
+    int columns;
+
+    // Amount of vertices per channel, including the 2 bridging vertices.
+    int stride;
+    // Amount of channels in use; the geometry may hold spare vertices after them.
+    int channels;
+
+private:
+    void updateBlending();
+
+    QVector<QColor> m_palette;
+};
+
+class ScopeTraceNode : public QSGGeometryNode
+{
+public:
+    ScopeTraceNode();
+
+    // Prepares geometry for 'channels' tracks of 'frames' each, reduced
+    // to 'columns' min-max pairs if 'columns' > 0.
+    void setFormat( int channels, int frames, int columns );
+    // Requires channels to be set in order, starting with 0.
+    void setChannelData( int channel, const float * data );
+    void setChannelColor( int channel, const QColor & color );
+    void setPlacement( float xOffset, float xScale,
+                       float yBase, float yStep, float yScale );
+
+private:
+    QSGGeometry m_geometry;
+    ScopeTraceMaterial m_material;
+    int m_channels;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SCOPE_TRACE_INCLUDED
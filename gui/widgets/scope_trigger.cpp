@@ -0,0 +1,123 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scope_trigger.hpp"
+#include "scope_kernels.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace QuickCollider {
+
+ScopeTrigger::ScopeTrigger():
+    m_single_armed(true),
+    m_channels(0),
+    m_frames(0),
+    m_has_previous(false),
+    m_position(0),
+    m_next_allowed(0),
+    m_armed(false)
+{}
+
+void ScopeTrigger::setSettings( const ScopeTriggerSettings & settings )
+{
+    // A different signal or edge makes the arming state meaningless.
+    if (settings.channel != m_settings.channel || settings.rising != m_settings.rising)
+        m_armed = false;
+
+    m_settings = settings;
+}
+
+void ScopeTrigger::reset()
+{
+    m_channels = 0;
+    m_frames = 0;
+    m_history.clear();
+    m_has_previous = false;
+    m_position = 0;
+    m_next_allowed = 0;
+    m_armed = false;
+}
+
+bool ScopeTrigger::process( const float * data, int channels, int frames, int stride,
+                            ScopeFrame & out )
+{
+    if (channels < 1 || frames < 1)
+        return false;
+
+    if (channels != m_channels || frames != m_frames) {
+        reset();
+        m_channels = channels;
+        m_frames = frames;
+        m_history.resize( channels * frames * 2 );
+    }
+
+    // Shift the current frame into place of the previous one, and append the new one.
+    for (int ch = 0; ch < channels; ++ch) {
+        float *history = &m_history[ch * frames * 2];
+        std::memcpy( history, history + frames, frames * sizeof(float) );
+        std::memcpy( history + frames, data + ch * stride, frames * sizeof(float) );
+    }
+
+    if (!m_has_previous) {
+        m_has_previous = true;
+        m_position = 0;
+        m_next_allowed = 0;
+    }
+    else {
+        m_position += frames;
+
+        bool waiting = m_settings.mode == ScopeTriggerSettings::Single && !m_single_armed;
+        int channel = m_settings.channel;
+
+        if (!waiting && channel >= 0 && channel < channels)
+        {
+            // Search the previous frame only, so any trigger is followed by a full window.
+            // Every part of the stream is thus searched exactly once.
+            int from = (int) std::max( 0LL, std::min<long long>(m_next_allowed - m_position, frames) );
+            const float *history = &m_history[channel * frames * 2];
+            int found = ScopeKernels::get().findTrigger( history + from, frames - from,
+                                                         m_settings.level, m_settings.hysteresis,
+                                                         m_settings.rising, m_armed );
+            if (found >= 0) {
+                int start = from + found;
+                m_next_allowed = m_position + start + std::max(1, m_settings.holdoff);
+                if (m_settings.mode == ScopeTriggerSettings::Single)
+                    m_single_armed = false;
+                writeWindow( start, out );
+                return true;
+            }
+        }
+    }
+
+    if (m_settings.mode == ScopeTriggerSettings::Auto) {
+        writeWindow( frames, out );
+        return true;
+    }
+
+    return false;
+}
+
+void ScopeTrigger::writeWindow( int start, ScopeFrame & out )
+{
+    out.resize( m_channels, m_frames );
+    for (int ch = 0; ch < m_channels; ++ch)
+        std::memcpy( out.channel(ch), &m_history[ch * m_frames * 2 + start],
+                     m_frames * sizeof(float) );
+}
+
+} // namespace QuickCollider
@@ -0,0 +1,102 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SCOPE_TRIGGER_INCLUDED
+#define QUICK_COLLIDER_SCOPE_TRIGGER_INCLUDED
+
+#include "scope_frame_buffer.hpp"
+
+#include <vector>
+
+namespace QuickCollider {
+
+struct ScopeTriggerSettings
+{
+    enum Mode {
+        // Free-runs while no trigger is found.
+        Auto,
+        // Only shows triggered windows.
+        Normal,
+        // Shows one triggered window, then waits to be armed again.
+        Single
+    };
+
+    ScopeTriggerSettings():
+        mode(Auto),
+        rising(true),
+        channel(0),
+        level(0.f),
+        hysteresis(0.01f),
+        holdoff(0)
+    {}
+
+    Mode mode;
+    bool rising;
+    int channel;
+    float level;
+    float hysteresis;
+    // Minimum amount of frames from one trigger to the next.
+    int holdoff;
+};
+
+// Turns successive scope frames into windows starting at a trigger point.
+//
+// Scope frames are treated as consecutive parts of a stream. The previous
+// frame is kept, so that a trigger found anywhere in it can be followed by
+// a full frame worth of data; the display lags behind by one frame.
+
+class ScopeTrigger
+{
+public:
+    ScopeTrigger();
+
+    void setSettings( const ScopeTriggerSettings & settings );
+    const ScopeTriggerSettings & settings() const { return m_settings; }
+
+    // In Single mode, allows the next trigger to be shown.
+    void arm() { m_single_armed = true; }
+    bool isSingleArmed() const { return m_single_armed; }
+
+    // Forgets the stream so far.
+    void reset();
+
+    // Feeds the next frame, 'stride' apart for each channel.
+    // Returns whether a new window was written to 'out'.
+    bool process( const float * data, int channels, int frames, int stride,
+                  ScopeFrame & out );
+
+private:
+    void writeWindow( int start, ScopeFrame & out );
+
+    ScopeTriggerSettings m_settings;
+    bool m_single_armed;
+
+    // Previous and current frame for each channel, one after another.
+    std::vector<float> m_history;
+    int m_channels;
+    int m_frames;
+    bool m_has_previous;
+
+    // Stream position of the start of history, and of the earliest next trigger.
+    long long m_position;
+    long long m_next_allowed;
+    bool m_armed;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SCOPE_TRIGGER_INCLUDED
@@ -0,0 +1,85 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sf_cache_sample.hpp"
+
+namespace QuickCollider {
+
+namespace {
+
+const float companding = 255.f; // mu
+const int maxCode = 127; // symmetric; -128 is not used
+
+struct CompandingTables
+{
+    CompandingTables()
+    {
+        float scale = std::log1p( companding );
+
+        for (int code = -128; code <= 127; ++code) {
+            int magnitude = std::min( std::abs(code), maxCode );
+            float value = std::expm1( magnitude * scale / maxCode ) / companding * SHRT_MAX;
+            decode[code + 128] = code < 0 ? -value : value;
+        }
+
+        for (int sample = SHRT_MIN; sample <= SHRT_MAX; ++sample) {
+            float magnitude = std::min( std::abs(sample), (int) SHRT_MAX ) / (float) SHRT_MAX;
+            int code = std::lround( std::log1p( companding * magnitude ) / scale * maxCode );
+            encode[sample - SHRT_MIN] = sample < 0 ? -code : code;
+        }
+    }
+
+    float decode[256];
+    signed char encode[1 << 16];
+};
+
+const CompandingTables & compandingTables()
+{
+    static CompandingTables tables;
+    return tables;
+}
+
+} // namespace
+
+const float * SoundCacheSample<signed char>::decodeTable()
+{
+    return compandingTables().decode;
+}
+
+signed char SoundCacheSample<signed char>::nearest( float value )
+{
+    int sample = std::lround( std::max( (float) SHRT_MIN, std::min( (float) SHRT_MAX, value ) ) );
+    return compandingTables().encode[sample - SHRT_MIN];
+}
+
+signed char SoundCacheSample<signed char>::lower( float value )
+{
+    signed char code = nearest( value );
+    if (code > -maxCode && SoundCacheSample::value( code ) > value)
+        --code;
+    return code;
+}
+
+signed char SoundCacheSample<signed char>::upper( float value )
+{
+    signed char code = nearest( value );
+    if (code < maxCode && SoundCacheSample::value( code ) < value)
+        ++code;
+    return code;
+}
+
+} // namespace QuickCollider
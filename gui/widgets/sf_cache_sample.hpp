@@ -0,0 +1,72 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SOUND_CACHE_SAMPLE_INCLUDED
+#define QUICK_COLLIDER_SOUND_CACHE_SAMPLE_INCLUDED
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace QuickCollider {
+
+// Encoding of the minima and maxima stored in a SoundCacheStream, for each
+// precision it supports. Values are in the 16-bit sample range.
+//
+// lower() and upper() return the closest code whose value is not above,
+// respectively not below, the given one, so that peaks are never drawn
+// smaller than they are. Codes compare like their values.
+
+template <typename T> struct SoundCacheSample;
+
+// 8-bit codes, companded logarithmically (mu-law) so that quiet signals
+// keep a useful resolution.
+template <> struct SoundCacheSample<signed char>
+{
+    static signed char lower( float value );
+    static signed char upper( float value );
+    static float value( signed char code ) { return decodeTable()[code + 128]; }
+
+private:
+    static signed char nearest( float value );
+    static const float * decodeTable();
+};
+
+template <> struct SoundCacheSample<short>
+{
+    static short lower( float value ) { return clamp( std::floor( value ) ); }
+    static short upper( float value ) { return clamp( std::ceil( value ) ); }
+    static float value( short code ) { return code; }
+
+private:
+    static short clamp( float value )
+    {
+        return std::max( (float) SHRT_MIN, std::min( (float) SHRT_MAX, value ) );
+    }
+};
+
+// Exact, for data integrated from float samples.
+template <> struct SoundCacheSample<float>
+{
+    static float lower( float value ) { return value; }
+    static float upper( float value ) { return value; }
+    static float value( float code ) { return code; }
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SOUND_CACHE_SAMPLE_INCLUDED
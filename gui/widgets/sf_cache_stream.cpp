@@ -20,75 +20,346 @@
 ************************************************************************/
 
 #include "sf_view.hpp"
+#include "sf_kernels.hpp"
+#include "sf_cache_sample.hpp"
 
 #include <cstring>
 #include <cmath>
 
 namespace QuickCollider {
 
+// Units per chunk are a power of two, so that units of levels up to the
+// chunk level are complete within a chunk. Chunks have at most
+// 2^loaderMaxChunkLevels units, and as many as fit loaderChunkSamples
+// samples over all channels, but at least one.
+static const int loaderMaxChunkLevels = 10;
+static const int loaderMaxChunkSize = 1 << loaderMaxChunkLevels;
+static const sf_count_t loaderChunkSamples = 1 << 16;
+// The overview is the first level with at most this many units,
+// but not above the chunk level, so that chunks refine it.
+static const int overviewUnits = 8192;
+// Frames sampled per overview unit
+static const int overviewFrames = 256;
+
+static size_t sampleSize( SoundCachePrecision precision )
+{
+  switch( precision ) {
+  case CachePrecision8: return sizeof(signed char);
+  case CachePrecisionFloat: return sizeof(float);
+  default: return sizeof(short);
+  }
+}
+
+// Bytes of minima or maxima of 'units', padded to keep following floats aligned.
+static size_t extremeBytes( SoundCachePrecision precision, sf_count_t units )
+{
+  return (units * sampleSize( precision ) + 3) / 4 * 4;
+}
+
+// Adds 'count' units to 'sums'; vectorized for 16-bit extremes.
+template <typename T>
+inline void cacheSums( const SoundKernels &, const T *min, const T *max,
+                       const float *sum, const float *sum2, int count, SoundColumnSums & sums )
+{
+  for( int i = 0; i < count; ++i )
+    sums.add( SoundCacheSample<T>::value( min[i] ), SoundCacheSample<T>::value( max[i] ),
+              sum[i], sum2[i] );
+}
+inline void cacheSums( const SoundKernels & kernels, const short *min, const short *max,
+                       const float *sum, const float *sum2, int count, SoundColumnSums & sums )
+{
+  SoundSums s = { SHRT_MAX, SHRT_MIN, 0.0, 0.0 };
+  kernels.cacheSums( min, max, sum, sum2, count, s );
+  sums.add( s.min, s.max, s.sum, s.sum_of_squares );
+}
+
+// Reads frames through the cache's file mapping, if open; otherwise through
+// a libsndfile handle, locking 'mutex' around it if given.
+struct SoundReader
+{
+  const SoundFileMapping *mapping;
+  SNDFILE *sf;
+  SF_INFO info;
+  QMutex *mutex;
+  bool floatSamples;
+
+  void read( SoundFileStream & buffer, sf_count_t beg, sf_count_t dur )
+  {
+    if( mapping ) {
+      buffer.load( *mapping, beg, dur, floatSamples );
+      return;
+    }
+    if( mutex ) mutex->lock();
+    buffer.load( sf, info, beg, dur, floatSamples );
+    if( mutex ) mutex->unlock();
+  }
+};
+
+class SoundCacheWorker : public QThread
+{
+public:
+  SoundCacheWorker( SoundCacheLoader *loader ) : QThread( loader ), _loader( loader ) {}
+
+private:
+  void run()
+  {
+    // Kept for all chunks of a pass, and freed after it.
+    SoundFileStream buffer;
+    _loader->work( buffer );
+  }
+
+  SoundCacheLoader *_loader;
+};
+
 SoundCacheStream::SoundCacheStream()
 : SoundStream ( 0, 0.0, 0.0 ),
-  _caches(0),
+  _precision(CachePrecision16),
+  _nextPrecision(CachePrecision16),
+  _storage(0),
   _fpu(0.0),
   _dataOffset(0),
   _dataSize(0),
   _ready(false),
   _loading(false),
-  _loadProgress(0)
+  _loadProgress(0),
+  _generation(0),
+  _overviewLevel(-1),
+  _sf(0),
+  _maxRawSamples(0),
+  _rawWindow(0)
 {
+  memset( &_info, 0, sizeof(SF_INFO) );
+
   _loader = new SoundCacheLoader( this );
-  connect( _loader, SIGNAL(loadProgress(int)),
-           this, SLOT(onLoadProgress(int)),
+  connect( _loader, SIGNAL(loadProgress(int, int)),
+           this, SLOT(onLoadProgress(int, int)),
            Qt::QueuedConnection );
-  connect( _loader, SIGNAL(loadingDone()), this, SLOT(onLoadingDone()), Qt::QueuedConnection );
+  connect( _loader, SIGNAL(overviewDone(int, int)),
+           this, SLOT(onOverviewDone(int, int)),
+           Qt::QueuedConnection );
+  connect( _loader, SIGNAL(loadingDone(int)), this, SLOT(onLoadingDone(int)), Qt::QueuedConnection );
+
+  _rawLoader = new SoundRawLoader( this );
+  connect( _rawLoader, SIGNAL(loaded()), this, SLOT(onRawWindowLoaded()), Qt::QueuedConnection );
 }
 
 SoundCacheStream::~SoundCacheStream()
 {
-  if( _loader->isRunning() ) {
-    _loader->terminate();
-    _loader->wait();
-  }
-  delete [] _caches;
+  _loader->stop();
+  _rawLoader->wait();
+  clear();
 }
 
-void SoundCacheStream::load( const QVector<double> & data, int nf, int offset, int ch )
+void SoundCacheStream::reset()
 {
-  if( _loader->isRunning() ) {
-    _loader->terminate();
-    _loader->wait();
-  }
+  _loader->stop();
+  ++_generation;
 
+  clear();
+
+  _ch = 0;
+  _beg = _dur = 0;
+  _dataOffset = _dataSize = 0;
+  _fpu = 0.0;
   _ready = false;
-  _loading = true;
+  _loading = false;
   _loadProgress = 0;
+}
 
-  delete [] _caches;
+void SoundCacheStream::clear()
+{
+  _rawLoader->wait();
+  delete _rawLoader->take();
+  delete _rawWindow;
+  _rawWindow = 0;
+  _sf = 0;
+  _path.clear();
+  _overviewLevel = -1;
+
+  _caches.clear();
+  _levelSizes.clear();
+  if( _storage != _peakFile.data() )
+    delete [] _storage;
+  _storage = 0;
+  _peakFile.close();
+  // After the raw window, which may point into it.
+  _mapping.close();
+  _peakKey = SoundPeakFile::Key();
+  std::vector<float>().swap( _rawFrames );
+}
 
-  _ch = ch;
-  _beg = _dataOffset = 0;
-  _dur = _dataSize = nf;
-  _fpu = 1.0;
+size_t SoundCacheStream::layoutLevels( int channels, sf_count_t units )
+{
+  // New data has the precision last set.
+  _precision = _nextPrecision;
+
+  _levelSizes.clear();
+  _levelSizes.push_back( units );
+  while( _levelSizes.back() > 1 )
+    _levelSizes.push_back( (_levelSizes.back() + 1) / 2 );
+
+  size_t total = 0;
+  for( size_t level = 0; level < _levelSizes.size(); ++level ) {
+    sf_count_t n = _levelSizes[level];
+    total += (2 * n * sizeof(float) + 2 * extremeBytes( _precision, n )) * channels;
+  }
+  return total;
+}
 
-  _caches = new SoundCache [ch];
+void SoundCacheStream::setStorage( char *storage )
+{
+  // Per level and channel: sum, sum2, min, max. Each block is padded to
+  // a multiple of 4 bytes, so the float arrays stay aligned.
+  // NOTE: This is the layout of peak files too; change their version with it.
+  _storage = storage;
+
+  _caches.resize( _levelSizes.size() * _ch );
+  char *data = _storage;
+  for( size_t level = 0; level < _levelSizes.size(); ++level ) {
+    size_t n = _levelSizes[level];
+    for( int ch = 0; ch < _ch; ++ch ) {
+      SoundCache & c = _caches[level * _ch + ch];
+      size_t bytes = extremeBytes( _precision, n );
+      c.sum = reinterpret_cast<float*>( data );
+      c.sum2 = c.sum + n;
+      c.min = c.sum2 + n;
+      c.max = static_cast<char*>( c.min ) + bytes;
+      data += 2 * n * sizeof(float) + 2 * bytes;
+    }
+  }
+}
 
-  for( int c = 0; c < ch; ++c )
+void SoundCacheStream::reduceLevels( sf_count_t begin, sf_count_t end, int firstLevel, int lastLevel )
+{
+  int levelCount = _levelSizes.size();
+  if( lastLevel >= 0 )
+    levelCount = std::min( levelCount, lastLevel + 1 );
+  for( int level = 1; level < levelCount; ++level )
   {
-    short *min = _caches[c].min = new short [nf];
-    short *max = _caches[c].max = new short [nf];
-    float *sum = _caches[c].sum = new float [nf];
-    float *sum2 = _caches[c].sum2 = new float [nf];
+    sf_count_t childCount = _levelSizes[level - 1];
+    begin = begin / 2;
+    end = std::min( (end + 1) / 2, _levelSizes[level] );
+    if( level < firstLevel )
+      continue;
 
-    int s = c + (offset * ch);
-    for( int f = 0; f < nf; ++f, s += ch )
+    for( int ch = 0; ch < _ch; ++ch )
+    {
+      const SoundCache & src = cache( level - 1, ch );
+      SoundCache & dst = cache( level, ch );
+      for( sf_count_t u = begin; u < end; ++u ) {
+        sf_count_t a = u * 2;
+        sf_count_t b = a + 1 < childCount ? a + 1 : a;
+        dst.sum[u] = b != a ? src.sum[a] + src.sum[b] : src.sum[a];
+        dst.sum2[u] = b != a ? src.sum2[a] + src.sum2[b] : src.sum2[a];
+      }
+
+      switch( _precision ) {
+      case CachePrecision8:
+        reduceExtremes<signed char>( src, dst, begin, end, childCount ); break;
+      case CachePrecisionFloat:
+        reduceExtremes<float>( src, dst, begin, end, childCount ); break;
+      default:
+        reduceExtremes<short>( src, dst, begin, end, childCount );
+      }
+    }
+  }
+}
+
+template <typename T>
+void SoundCacheStream::reduceExtremes( const SoundCache & src, SoundCache & dst,
+                                       sf_count_t begin, sf_count_t end, sf_count_t srcSize )
+{
+  // Codes of all precisions compare like their values.
+  const T *srcMin = src.minimum<T>();
+  const T *srcMax = src.maximum<T>();
+  T *dstMin = dst.minimum<T>();
+  T *dstMax = dst.maximum<T>();
+  for( sf_count_t u = begin; u < end; ++u ) {
+    sf_count_t a = u * 2;
+    sf_count_t b = a + 1 < srcSize ? a + 1 : a;
+    dstMin[u] = std::min( srcMin[a], srcMin[b] );
+    dstMax[u] = std::max( srcMax[a], srcMax[b] );
+  }
+}
+
+void SoundCacheStream::storeExtremes( SoundCache & c, sf_count_t unit,
+                                      const float *min, const float *max, int count )
+{
+  switch( _precision ) {
+  case CachePrecision8:
+    storeExtremesAs<signed char>( c, unit, min, max, count ); break;
+  case CachePrecisionFloat:
+    memcpy( c.minimum<float>() + unit, min, count * sizeof(float) );
+    memcpy( c.maximum<float>() + unit, max, count * sizeof(float) );
+    break;
+  default:
+    storeExtremesAs<short>( c, unit, min, max, count );
+  }
+}
+
+template <typename T>
+void SoundCacheStream::storeExtremesAs( SoundCache & c, sf_count_t unit,
+                                        const float *min, const float *max, int count )
+{
+  T *dstMin = c.minimum<T>() + unit;
+  T *dstMax = c.maximum<T>() + unit;
+  for( int i = 0; i < count; ++i ) {
+    dstMin[i] = SoundCacheSample<T>::lower( min[i] );
+    dstMax[i] = SoundCacheSample<T>::upper( max[i] );
+  }
+}
+
+// Frame f of level 0 is frame f + dataOffset of the interleaved 'data'.
+template <typename T>
+void SoundCacheStream::storeFrames( const QVector<double> & data, int dataOffset, int begin, int end )
+{
+  for( int c = 0; c < _ch; ++c )
+  {
+    T *min = cache(0, c).minimum<T>();
+    T *max = cache(0, c).maximum<T>();
+    float *sum = cache(0, c).sum;
+    float *sum2 = cache(0, c).sum2;
+
+    int s = c + (begin + dataOffset) * _ch;
+    for( int f = begin; f < end; ++f, s += _ch )
     {
       double val = std::max(-1.0, std::min(1.0, data[s])) * SHRT_MAX;
-      min[f] = val;
+      min[f] = SoundCacheSample<T>::lower( val );
+      max[f] = SoundCacheSample<T>::upper( val );
       sum[f] = val;
       sum2[f] = val * val;
     }
-    memcpy( max, min, nf * sizeof(short) );
   }
+}
+
+void SoundCacheStream::load( const QVector<double> & data, int nf, int offset, int ch )
+{
+  _loader->stop();
+  ++_generation;
+
+  _ready = false;
+  _loading = true;
+  _loadProgress = 0;
+
+  clear();
+
+  _ch = ch;
+  _beg = _dataOffset = 0;
+  _dur = _dataSize = nf;
+  _fpu = 1.0;
+
+  setStorage( new char [layoutLevels( ch, nf )] );
+
+  switch( _precision ) {
+  case CachePrecision8:
+    storeFrames<signed char>( data, offset, 0, nf ); break;
+  case CachePrecisionFloat:
+    storeFrames<float>( data, offset, 0, nf ); break;
+  default:
+    storeFrames<short>( data, offset, 0, nf );
+  }
+
+  reduceLevels( 0, nf );
 
   _loadProgress = 100;
   _loading = false;
@@ -96,51 +367,64 @@ void SoundCacheStream::load( const QVector<double> & data, int nf, int offset, i
   Q_EMIT( loadingDone() );
 }
 
-void SoundCacheStream::load( SNDFILE *sf, const SF_INFO &info, sf_count_t beg, sf_count_t dur,
-                             int maxFramesPerUnit, int maxRawFrames )
+void SoundCacheStream::load( SNDFILE *sf, const SF_INFO &info, const QString & path,
+                             sf_count_t beg, sf_count_t dur,
+                             int maxUnits, int maxFramesPerUnit, int maxRawSamples )
 {
-  Q_ASSERT( maxRawFrames > 0 && maxFramesPerUnit > 0 );
+  Q_ASSERT( maxRawSamples > 0 && maxUnits > 0 && maxFramesPerUnit > 0 );
 
   _ready = false;
   _loadProgress = 0;
 
-  if( _loader->isRunning() ) {
-    _loader->terminate();
-    _loader->wait();
-  }
-  delete [] _caches;
+  _loader->stop();
+  ++_generation;
+  clear();
 
   _ch = info.channels;
   _beg = _dataOffset = beg;
   _dur = dur;
 
-  // adjust data size for data amount limit
-  if( _dur <= maxRawFrames ) {
-     // ok, not crossing the limit
-    _dataSize = _dur;
-    _fpu = 1.0;
-  }
-  else {
-    _dataSize = maxRawFrames;
-    _fpu = (double) _dur / _dataSize;
-    // re-adjust for data resolution limit
-    if( _fpu > maxFramesPerUnit ) {
-      _dataSize = (double) _dur / maxFramesPerUnit;
-      _fpu = (double) _dur / _dataSize;
+  // Smallest power-of-two resolution within the data amount limit, unless
+  // beyond the frames per unit limit.
+  // Whole frames per unit keep units aligned to frames at every level.
+  sf_count_t fpu = 1;
+  while( fpu * 2 <= maxFramesPerUnit && (dur + fpu - 1) / fpu * info.channels > maxUnits )
+    fpu *= 2;
+  _fpu = fpu;
+  _dataSize = (dur + fpu - 1) / fpu;
+
+  size_t storageSize = layoutLevels( info.channels, _dataSize );
+
+  _sf = sf;
+  _info = info;
+  _path = path;
+  _maxRawSamples = maxRawSamples;
+
+  if( !path.isEmpty() )
+    _mapping.open( path, info );
+
+  if( !path.isEmpty() && _peakKey.setSource( path ) ) {
+    _peakKey.beginning = beg;
+    _peakKey.duration = dur;
+    _peakKey.channels = info.channels;
+    _peakKey.fpu = fpu;
+    _peakKey.precision = _precision;
+    _peakKey.dataSize = storageSize;
+
+    if( _peakFile.open( _peakKey ) ) {
+      setStorage( _peakFile.data() );
+      _loadProgress = 100;
+      _loading = false;
+      _ready = true;
+      Q_EMIT( loadingDone() );
+      return;
     }
   }
 
-  _caches = new SoundCache [info.channels];
-  int ch;
-  for( ch = 0; ch < info.channels; ++ch ) {
-    _caches[ch].min = new short [_dataSize];
-    _caches[ch].max = new short [_dataSize];
-    _caches[ch].sum = new float [_dataSize];
-    _caches[ch].sum2 = new float [_dataSize];
-  }
+  setStorage( new char [storageSize] );
 
   _loading = true;
-  _loader->load( sf, info );
+  _loader->load( _generation );
 }
 
 void SoundCacheStream::allocate ( int nf, int ch )
@@ -148,33 +432,32 @@ void SoundCacheStream::allocate ( int nf, int ch )
 
   Q_ASSERT( nf > 0 && ch > 0 );
 
-  if( _loader->isRunning() ) {
-    _loader->terminate();
-    _loader->wait();
-  }
+  _loader->stop();
+  ++_generation;
 
-  delete [] _caches;
+  clear();
 
   _ch = ch;
   _beg = _dataOffset = 0;
   _dur = _dataSize = nf;
   _fpu = 1.0;
 
-  _caches = new SoundCache [ch];
+  setStorage( new char [layoutLevels( ch, nf )] );
 
-  for( int c = 0; c < ch; ++c )
+  for( int level = 0; level < levels(); ++level )
   {
-    short *min = _caches[c].min = new short [nf];
-    short *max = _caches[c].max = new short [nf];
-    float *sum = _caches[c].sum = new float [nf];
-    float *sum2 = _caches[c].sum2 = new float [nf];
-
-    size_t bytes = nf * sizeof(short);
-    memset( min, 0, bytes );
-    memset( max, 0, bytes );
-    bytes = nf * sizeof(float);
-    memset( sum, 0, bytes );
-    memset( sum2, 0, bytes );
+    for( int c = 0; c < ch; ++c )
+    {
+      SoundCache & data = cache( level, c );
+      sf_count_t n = _levelSizes[level];
+      // Zero is coded as zero in all precisions.
+      size_t bytes = extremeBytes( _precision, n );
+      memset( data.min, 0, bytes );
+      memset( data.max, 0, bytes );
+      bytes = n * sizeof(float);
+      memset( data.sum, 0, bytes );
+      memset( data.sum2, 0, bytes );
+    }
   }
 
   _loadProgress = 100;
@@ -192,45 +475,87 @@ void SoundCacheStream::write( const QVector<double> & data, int offset, int coun
   // make sure range is ok
   Q_ASSERT( offset >= 0 && end <= _dataSize );
 
-  for( int c = 0; c < _ch; ++c )
-  {
-    short *min = _caches[c].min;
-    short *max = _caches[c].max;
-    float *sum = _caches[c].sum;
-    float *sum2 = _caches[c].sum2;
-
-    int s = c;
-    for( int f = offset; f < end; ++f, s += _ch )
-    {
-      double val = std::max(-1.0, std::min(1.0, data[s])) * SHRT_MAX;
-      min[f] = val;
-      sum[f] = val;
-      sum2[f] = val * val;
-    }
-    memcpy( max + offset, min + offset, count * sizeof(short) );
+  switch( _precision ) {
+  case CachePrecision8:
+    storeFrames<signed char>( data, -offset, offset, end ); break;
+  case CachePrecisionFloat:
+    storeFrames<float>( data, -offset, offset, end ); break;
+  default:
+    storeFrames<short>( data, -offset, offset, end );
   }
+
+  reduceLevels( offset, end );
 }
 
 bool SoundCacheStream::displayData
 ( int ch, double f_beg, double f_dur,
-  short *minBuffer, short *maxBuffer, short *minRMS, short *maxRMS, int bufferSize )
+  float *minBuffer, float *maxBuffer, float *minRMS, float *maxRMS, int bufferSize )
 {
-  bool ok = _ready
+  bool ok = displayable()
             && ch < channels()
             && ( f_beg >= beginning() )
             && ( f_beg + f_dur <= beginning() + duration() )
-            && bufferSize <= f_dur * _fpu;
+            && bufferSize > 0;
   if( !ok ) return false;
 
-  double ratio = f_dur / _fpu / bufferSize;
-  double cache_pos = (f_beg - _dataOffset) / _fpu ;
-
-  short min = SHRT_MAX;
-  short max = SHRT_MIN;
+  switch( _precision ) {
+  case CachePrecision8:
+    return displayDataAs<signed char>( ch, f_beg, f_dur, minBuffer, maxBuffer,
+                                       minRMS, maxRMS, bufferSize );
+  case CachePrecisionFloat:
+    return displayDataAs<float>( ch, f_beg, f_dur, minBuffer, maxBuffer,
+                                 minRMS, maxRMS, bufferSize );
+  default:
+    return displayDataAs<short>( ch, f_beg, f_dur, minBuffer, maxBuffer,
+                                 minRMS, maxRMS, bufferSize );
+  }
+}
 
+template <typename T>
+bool SoundCacheStream::displayDataAs
+( int ch, double f_beg, double f_dur,
+  float *minBuffer, float *maxBuffer, float *minRMS, float *maxRMS, int bufferSize )
+{
   double D_SHRT_MAX = (double) SHRT_MAX;
   double D_SHRT_MIN = (double) SHRT_MIN;
 
+  // Choose the coarsest level that still has at least one unit per buffer element,
+  // but no finer one than loaded so far.
+  double fpp = f_dur / bufferSize;
+  int level = 0;
+  double fpu = _fpu;
+  while( level + 1 < levels() && (fpu * 2.0 <= fpp || (!_ready && level < _overviewLevel)) ) {
+    fpu *= 2.0;
+    ++level;
+  }
+  sf_count_t size = _levelSizes[level];
+  const SoundCache & data = cache( level, ch );
+  const T *dataMin = data.minimum<T>();
+  const T *dataMax = data.maximum<T>();
+
+  double ratio = fpp / fpu;
+  double cache_pos = (f_beg - _dataOffset) / fpu;
+
+  if( ratio < 1.0 ) {
+    // Zoomed in beyond level 0: every element shows the unit it falls in.
+    for( int i = 0; i < bufferSize; ++i ) {
+      sf_count_t f = std::min( (sf_count_t) cache_pos, size - 1 );
+      double avg = data.sum[f] / fpu;
+      double stdDev = std::sqrt( std::abs( data.sum2[f] / fpu - avg * avg ) );
+      minBuffer[i] = SoundCacheSample<T>::value( dataMin[f] );
+      maxBuffer[i] = SoundCacheSample<T>::value( dataMax[f] );
+      minRMS[i] = std::max(D_SHRT_MIN, std::min(D_SHRT_MAX, avg - stdDev ));
+      maxRMS[i] = std::max(D_SHRT_MIN, std::min(D_SHRT_MAX, avg + stdDev ));
+      cache_pos += ratio;
+    }
+    return true;
+  }
+
+  const SoundKernels & kernels = SoundKernels::get();
+
+  float min = SHRT_MAX;
+  float max = SHRT_MIN;
+
   int i;
   for( i = 0; i < bufferSize; ++i ) {
     int f = std::floor(cache_pos); // first frame
@@ -239,41 +564,37 @@ bool SoundCacheStream::displayData
 
     cache_pos += ratio;
     // Due to possibility of floating point operation failures.
-    if( cache_pos > _dataSize ) cache_pos = _dataSize;
+    if( cache_pos > size ) cache_pos = size;
     int frame_count = std::ceil(cache_pos) - f ;
     float frac1 = cache_pos + 1.f - std::ceil(cache_pos);
 
-    //short min = SHRT_MAX;
-    //short max = SHRT_MIN;
-    double sum = 0.0;
-    double sum2 = 0.0;
-
-    short *p_min = _caches[ch].min;
-    short *p_max = _caches[ch].max;
-    float *p_sum = _caches[ch].sum;
-    float *p_sum2 = _caches[ch].sum2;
-    int countdown = frame_count;
-    while( countdown-- ) {
+    SoundColumnSums sums = { min, max, 0.0, 0.0 };
 
+    if( frame_count > 0 ) {
       // NOTE for min-max, behave as if first frame was std::ceil(cache_pos) instead of floor(),
       // to not smudge too much at large scale
-      if( countdown < frame_count - 1 || no_overlap ) {
-        if( p_min[f] < min ) min = p_min[f];
-        if( p_max[f] > max ) max = p_max[f];
-      }
-
-      float frac;
-      if( countdown == frame_count - 1 ) frac = frac0;
-      else if( countdown == 0 ) frac = frac1;
-      else frac = 1.0;
+      if( no_overlap )
+        sums.add( SoundCacheSample<T>::value( dataMin[f] ), SoundCacheSample<T>::value( dataMax[f] ),
+                  0.0, 0.0 );
+      sums.sum += data.sum[f] * frac0;
+      sums.sum_of_squares += data.sum2[f] * frac0;
+    }
 
-      sum += p_sum[f] * frac;
-      sum2 += p_sum2[f] * frac;
+    if( frame_count > 1 ) {
+      cacheSums( kernels, dataMin + f + 1, dataMax + f + 1, data.sum + f + 1, data.sum2 + f + 1,
+                 frame_count - 2, sums );
 
-      ++f;
+      int l = f + frame_count - 1;
+      sums.add( SoundCacheSample<T>::value( dataMin[l] ), SoundCacheSample<T>::value( dataMax[l] ),
+                data.sum[l] * frac1, data.sum2[l] * frac1 );
     }
 
-    double n = f_dur / bufferSize;
+    min = sums.min;
+    max = sums.max;
+    double sum = sums.sum;
+    double sum2 = sums.sum_of_squares;
+
+    double n = fpp;
     double avg = sum / n;
     double stdDev = std::sqrt( abs((sum2 - (sum*avg) ) / n) );
 
@@ -290,14 +611,52 @@ bool SoundCacheStream::displayData
   return true;
 }
 
-short *SoundCacheStream::rawFrames( int ch, sf_count_t b, sf_count_t d, bool *interleaved )
+const float *SoundCacheStream::rawFrames( int ch, sf_count_t b, sf_count_t d, bool *interleaved )
 {
   if( !_ready || _fpu != 1.0 || ch > channels() ||
       b < _dataOffset || b + d > _dataOffset + _dataSize )
     return 0;
 
   *interleaved = false;
-  return _caches[ch].min + b - _dataOffset;
+  switch( _precision ) {
+  case CachePrecision8:
+    return rawFramesAs<signed char>( ch, b, d );
+  case CachePrecisionFloat:
+    return cache(0, ch).minimum<float>() + b - _dataOffset;
+  default:
+    return rawFramesAs<short>( ch, b, d );
+  }
+}
+
+template <typename T>
+const float *SoundCacheStream::rawFramesAs( int ch, sf_count_t b, sf_count_t d )
+{
+  // Valid until the next call.
+  _rawFrames.resize( d );
+  const T *src = cache(0, ch).minimum<T>() + b - _dataOffset;
+  for( sf_count_t f = 0; f < d; ++f )
+    _rawFrames[f] = SoundCacheSample<T>::value( src[f] );
+  return _rawFrames.data();
+}
+
+SoundStream *SoundCacheStream::rawWindow( sf_count_t b, sf_count_t d )
+{
+  if( _rawWindow && b >= _rawWindow->beginning()
+      && b + d <= _rawWindow->beginning() + _rawWindow->duration() )
+    return _rawWindow;
+
+  if( !_sf || _rawLoader->isRequested( b, d ) )
+    return 0;
+
+  // The whole range, which the frames per unit limit keep to a few screens,
+  // and room for scrolling in both directions within the budget.
+  sf_count_t windowSize = std::max( d, std::min( d * 3, (sf_count_t) _maxRawSamples / _ch ) );
+  sf_count_t windowBeg = b - (windowSize - d) / 2;
+  windowBeg = std::max( _beg, std::min( windowBeg, _beg + _dur - windowSize ) );
+  windowSize = std::min( windowSize, _beg + _dur - windowBeg );
+
+  _rawLoader->request( windowBeg, windowSize );
+  return 0;
 }
 
 /*SoundCacheLoader::SoundCacheLoader( SNDFILE *sf, const SF_INFO &info,
@@ -308,64 +667,377 @@ short *SoundCacheStream::rawFrames( int ch, sf_count_t b, sf_count_t d, bool *in
   maxRawFrames( maxRawFrames )
 {}*/
 
-void SoundCacheStream::onLoadProgress( int progress )
+void SoundCacheStream::onLoadProgress( int generation, int progress )
 {
+  if( generation != _generation )
+    return;
   _loadProgress = progress;
   Q_EMIT( loadProgress(progress) );
 }
 
-void SoundCacheStream::onLoadingDone()
+void SoundCacheStream::onLoadingDone( int generation )
 {
-  // FIXME what if the signal is received just after starting another load?
+  // Received just after starting another load?
+  if( generation != _generation )
+    return;
   _ready = true;
   _loading = false;
   Q_EMIT( loadingDone() );
 }
 
-void SoundCacheLoader::load( SNDFILE *sf, const SF_INFO &info )
+void SoundCacheStream::onOverviewDone( int generation, int level )
 {
-  Q_ASSERT( !isRunning() );
-  _sf = sf;
-  _info = info;
-  start();
+  if( generation != _generation )
+    return;
+  _overviewLevel = level;
+  Q_EMIT( overviewReady() );
+}
+
+void SoundCacheStream::onRawWindowLoaded()
+{
+  SoundFileStream *window = _rawLoader->take();
+  if( !window )
+    return;
+  delete _rawWindow;
+  _rawWindow = window;
+  Q_EMIT( rawWindowReady() );
+}
+
+SoundCacheLoader::SoundCacheLoader( SoundCacheStream *cache ) :
+  QThread( cache ),
+  _cache( cache ),
+  _nextChunk( 0 ),
+  _unitsDone( 0 ),
+  _progress( 0 ),
+  _cancel( false ),
+  _generation( 0 ),
+  _overviewLevel( -1 ),
+  _chunkLevels( 0 ),
+  _sampling( false ),
+  _requested( false ),
+  _busy( false ),
+  _quit( false )
+{
+  int count = std::max( 1, QThread::idealThreadCount() );
+  for( int i = 0; i < count; ++i )
+    _workers.push_back( new SoundCacheWorker( this ) );
+}
+
+SoundCacheLoader::~SoundCacheLoader()
+{
+  stop();
+  {
+    QMutexLocker locker( &_mutex );
+    _quit = true;
+    _requestCondition.wakeOne();
+  }
+  wait();
+}
+
+void SoundCacheLoader::load( int generation )
+{
+  QMutexLocker locker( &_mutex );
+  Q_ASSERT( !_busy );
+  _generation = generation;
+  _requested = true;
+  _busy = true;
+  _requestCondition.wakeOne();
+  if( !isRunning() )
+    start();
+}
+
+void SoundCacheLoader::stop()
+{
+  QMutexLocker locker( &_mutex );
+  if( _requested ) {
+    // Not picked up yet.
+    _requested = false;
+    _busy = false;
+    return;
+  }
+  if( _busy ) {
+    _cancel = true;
+    while( _busy )
+      _idleCondition.wait( &_mutex );
+    _cancel = false;
+  }
 }
 
 void SoundCacheLoader::run()
 {
-  Q_ASSERT( _sf );
+  forever {
+    int generation;
+    {
+      QMutexLocker locker( &_mutex );
+      while( !_requested && !_quit )
+        _requestCondition.wait( &_mutex );
+      if( _quit )
+        return;
+      _requested = false;
+      generation = _generation;
+    }
 
+    loadCache( generation );
+
+    {
+      QMutexLocker locker( &_mutex );
+      _busy = false;
+      _idleCondition.wakeAll();
+    }
+  }
+}
+
+void SoundCacheLoader::loadCache( int generation )
+{
+  Q_ASSERT( _cache->_sf );
+
+  sf_count_t size = _cache->_dataSize;
+  const std::vector<sf_count_t> & levelSizes = _cache->_levelSizes;
+
+  sf_count_t unitSamples = (sf_count_t) _cache->_fpu * _cache->channels();
+  _chunkLevels = 0;
+  while( _chunkLevels < loaderMaxChunkLevels
+         && (unitSamples << (_chunkLevels + 1)) <= loaderChunkSamples )
+    ++_chunkLevels;
+  sf_count_t chunkSize = (sf_count_t) 1 << _chunkLevels;
+
+  // An overview is only worth it if sampling skips most of the file.
+  int level = 0;
+  while( level < _chunkLevels && level + 1 < (int) levelSizes.size()
+         && levelSizes[level] > overviewUnits )
+    ++level;
+  if( level > 0 && ((sf_count_t) _cache->_fpu << level) >= overviewFrames * 4 ) {
+    _overviewLevel = level;
+    _sampling = true;
+    runWorkers( levelSizes[level] );
+    if( _cancel )
+      return;
+
+    _cache->reduceLevels( 0, size, level + 1 );
+
+    Q_EMIT( overviewDone( generation, level ) );
+  }
+
+  _sampling = false;
+  _unitsDone = 0;
+  _progress = 0;
+  runWorkers( (size + chunkSize - 1) / chunkSize );
+  if( _cancel )
+    return;
+
+  // Units above the chunk levels combine the results of several workers.
+  _cache->reduceLevels( 0, size, _chunkLevels + 1 );
+
+  // Only the loader writes the data meanwhile.
+  if( !_cache->_peakKey.path.isEmpty() )
+    SoundPeakFile::write( _cache->_peakKey, _cache->_storage );
+
+  Q_EMIT( loadingDone( generation ) );
+}
+
+void SoundCacheLoader::runWorkers( sf_count_t tasks )
+{
+  _nextChunk = 0;
+
+  int workerCount = std::min( (sf_count_t) _workers.size(), tasks );
+  for( int i = 0; i < workerCount; ++i )
+    _workers[i]->start();
+  for( int i = 0; i < workerCount; ++i )
+    _workers[i]->wait();
+}
+
+void SoundCacheLoader::work( SoundFileStream & buffer )
+{
+  SoundReader reader;
+  reader.mapping = 0;
+  reader.sf = 0;
+  reader.mutex = 0;
+  reader.floatSamples = _cache->_precision == CachePrecisionFloat;
+
+  if( _cache->_mapping.isOpen() ) {
+    reader.mapping = &_cache->_mapping;
+  }
+  else {
+    // Open a handle of our own, if possible, so that workers do not wait
+    // for each other; otherwise share the one of the cache.
+    memset( &reader.info, 0, sizeof(SF_INFO) );
+    if( !_cache->_path.isEmpty() )
+      reader.sf = sf_open( _cache->_path.toStdString().c_str(), SFM_READ, &reader.info );
+    if( !reader.sf ) {
+      reader.sf = _cache->_sf;
+      reader.info = _cache->_info;
+      reader.mutex = &_cache->_sfMutex;
+    }
+  }
+
+  if( _sampling )
+    sampleOverview( reader, buffer );
+  else
+    integrateChunks( reader, buffer );
+
+  if( reader.sf && !reader.mutex )
+    sf_close( reader.sf );
+}
+
+void SoundCacheLoader::sampleOverview( SoundReader & reader, SoundFileStream & buffer )
+{
   int channels = _cache->channels();
-  double fpu = _cache->_fpu;
-  int size = _cache->_dataSize;
-  double offset = _cache->_dataOffset;
-  SoundCache *chanCaches = _cache->_caches;
+  int level = _overviewLevel;
+  sf_count_t size = _cache->_levelSizes[level];
+  sf_count_t span = (sf_count_t) _cache->_fpu << level;
+  sf_count_t offset = _cache->_dataOffset;
+  sf_count_t end = offset + _cache->duration();
+
+  while( !_cancel ) {
+    sf_count_t u = _nextChunk++;
+    if( u >= size )
+      break;
+
+    // Sample the middle of the unit.
+    sf_count_t unitBeg = offset + u * span;
+    sf_count_t unitDur = qMin( span, end - unitBeg );
+    sf_count_t dur = qMin( (sf_count_t) overviewFrames, unitDur );
+    sf_count_t beg = unitBeg + (unitDur - dur) / 2;
+
+    reader.read( buffer, beg, dur );
+
+    dur = buffer.duration();
+    if( dur < 1 )
+      continue;
+
+    // Sums as if the sample was representative of the whole unit.
+    float scale = (float) unitDur / dur;
+    for( int ch = 0; ch < channels; ++ch ) {
+      SoundCache & c = _cache->cache( level, ch );
+      float min, max;
+      buffer.integrate( ch, beg, dur, &min, &max, c.sum + u, c.sum2 + u, 1 );
+      _cache->storeExtremes( c, u, &min, &max, 1 );
+      c.sum[u] *= scale;
+      c.sum2[u] *= scale;
+    }
+  }
+}
+
+void SoundCacheLoader::integrateChunks( SoundReader & reader, SoundFileStream & buffer )
+{
+  int channels = _cache->channels();
+  sf_count_t fpu = _cache->_fpu;
+  sf_count_t size = _cache->_dataSize;
+  sf_count_t offset = _cache->_dataOffset;
+  sf_count_t end = offset + _cache->duration();
+
+  // Extremes of a chunk, as integrated before storing in the cache's precision
+  float min[loaderMaxChunkSize];
+  float max[loaderMaxChunkSize];
+  sf_count_t maxChunkSize = (sf_count_t) 1 << _chunkLevels;
 
-  int i = 0;
-  while( i < size ) {
-    int chunkSize = qMin( 1000, size - i );
+  while( !_cancel ) {
+    sf_count_t i = (sf_count_t) _nextChunk++ * maxChunkSize;
+    if( i >= size )
+      break;
 
-    double beg = i * fpu + offset;
-    double dur = chunkSize * fpu;
+    int chunkSize = qMin( maxChunkSize, size - i );
 
-    sf_count_t i_beg = std::floor(beg);
-    sf_count_t i_dur = std::ceil(beg+dur) - i_beg;
+    sf_count_t beg = i * fpu + offset;
+    sf_count_t dur = qMin( chunkSize * fpu, end - beg );
 
-    SoundFileStream sfStream( _sf, _info, i_beg, i_dur );
+    reader.read( buffer, beg, dur );
+
+    // The last unit of the data may be shorter.
+    int fullUnits = dur / fpu;
+    sf_count_t rest = dur - fullUnits * fpu;
 
     int ch;
     for( ch = 0; ch < channels; ++ch ) {
-      sfStream.integrate( ch, beg, dur,
-                          chanCaches[ch].min + i, chanCaches[ch].max + i,
-                          chanCaches[ch].sum + i, chanCaches[ch].sum2 + i,
-                          chunkSize );
+      SoundCache & c = _cache->cache( 0, ch );
+      if( fullUnits )
+        buffer.integrate( ch, beg, fullUnits * fpu,
+                          min, max, c.sum + i, c.sum2 + i,
+                          fullUnits );
+      if( rest ) {
+        sf_count_t u = i + fullUnits;
+        buffer.integrate( ch, beg + fullUnits * fpu, rest,
+                          min + fullUnits, max + fullUnits, c.sum + u, c.sum2 + u, 1 );
+      }
+      _cache->storeExtremes( c, i, min, max, fullUnits + (rest ? 1 : 0) );
     }
 
-    i += chunkSize;
+    // Also replaces the sampled overview of this chunk.
+    _cache->reduceLevels( i, i + chunkSize, 1, _chunkLevels );
 
-    Q_EMIT( loadProgress( i * 100 / size ) );
+    // Only the worker raising the progress reports it.
+    int progress = (sf_count_t) (_unitsDone += chunkSize) * 100 / size;
+    int last = _progress;
+    while( progress > last ) {
+      if( _progress.compare_exchange_weak( last, progress ) ) {
+        Q_EMIT( loadProgress( _generation, progress ) );
+        break;
+      }
+    }
   }
+}
 
-  Q_EMIT( loadingDone() );
+void SoundRawLoader::request( sf_count_t beg, sf_count_t dur )
+{
+  QMutexLocker locker( &_mutex );
+  _beg = _requestedBeg = beg;
+  _dur = _requestedDur = dur;
+  _pending = true;
+  if( !_busy ) {
+    _busy = true;
+    // run() may still be returning after its last request.
+    wait();
+    start();
+  }
+}
+
+bool SoundRawLoader::isRequested( sf_count_t beg, sf_count_t dur )
+{
+  QMutexLocker locker( &_mutex );
+  return _busy && beg >= _requestedBeg && beg + dur <= _requestedBeg + _requestedDur;
+}
+
+SoundFileStream *SoundRawLoader::take()
+{
+  QMutexLocker locker( &_mutex );
+  SoundFileStream *result = _result;
+  _result = 0;
+  return result;
+}
+
+void SoundRawLoader::run()
+{
+  forever {
+    sf_count_t beg, dur;
+    {
+      QMutexLocker locker( &_mutex );
+      if( !_pending ) {
+        _busy = false;
+        return;
+      }
+      beg = _beg;
+      dur = _dur;
+      _pending = false;
+    }
+
+    // As precise as the cache
+    bool floatSamples = _cache->_precision == CachePrecisionFloat;
+    SoundFileStream *window = new SoundFileStream;
+    if( _cache->_mapping.isOpen() ) {
+      window->load( _cache->_mapping, beg, dur, floatSamples );
+    }
+    else {
+      QMutexLocker locker( &_cache->_sfMutex );
+      window->load( _cache->_sf, _cache->_info, beg, dur, floatSamples );
+    }
+
+    {
+      QMutexLocker locker( &_mutex );
+      delete _result;
+      _result = window;
+    }
+    Q_EMIT( loaded() );
+  }
 }
 
 } // namespace QuickCollider
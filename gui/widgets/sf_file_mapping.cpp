@@ -0,0 +1,345 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sf_file_mapping.hpp"
+
+#include <QtEndian>
+
+#include <cstring>
+
+namespace QuickCollider {
+
+namespace {
+
+// Stores frames planar, converting each sample.
+template <typename T, typename Convert>
+void readPlanar( const uchar *src, int channels, int bytesPerSample,
+                 sf_count_t count, T *dest, Convert convert )
+{
+    for (sf_count_t frame = 0; frame < count; ++frame) {
+        for (int ch = 0; ch < channels; ++ch, src += bytesPerSample)
+            dest[ch * count + frame] = convert(src);
+    }
+}
+
+inline short floatToShort( quint32 bits )
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return floatSampleToShort(value);
+}
+
+inline float floatToScaled( quint32 bits )
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return scaleFloatSample(value);
+}
+
+} // namespace
+
+SoundFileMapping::SoundFileMapping():
+    _data(0),
+    _type(Int16),
+    _bytesPerSample(2),
+    _bigEndian(false),
+    _channels(0),
+    _frames(0)
+{}
+
+bool SoundFileMapping::open( const QString & path, const SF_INFO & info )
+{
+    close();
+
+    switch (info.format & SF_FORMAT_SUBMASK)
+    {
+    case SF_FORMAT_PCM_16:
+        _type = Int16; _bytesPerSample = 2; break;
+    case SF_FORMAT_PCM_24:
+        _type = Int24; _bytesPerSample = 3; break;
+    case SF_FORMAT_PCM_32:
+        _type = Int32; _bytesPerSample = 4; break;
+    case SF_FORMAT_FLOAT:
+        _type = Float32; _bytesPerSample = 4; break;
+    default:
+        return false;
+    }
+
+    if (info.channels < 1 || info.frames < 1)
+        return false;
+
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 offset, size;
+    qint64 needed = (qint64) info.frames * info.channels * _bytesPerSample;
+    if (!findData(info, &offset, &size) || size < needed || offset + needed > _file.size()) {
+        _file.close();
+        return false;
+    }
+
+    _data = _file.map(offset, needed);
+    if (!_data) {
+        _file.close();
+        return false;
+    }
+
+    _channels = info.channels;
+    _frames = info.frames;
+
+    return true;
+}
+
+void SoundFileMapping::close()
+{
+    if (_data)
+        _file.unmap(_data);
+    _data = 0;
+    _file.close();
+    _channels = 0;
+    _frames = 0;
+}
+
+const short * SoundFileMapping::monoShortData() const
+{
+    bool nativeOrder = _bigEndian == (Q_BYTE_ORDER == Q_BIG_ENDIAN);
+    if (_data && _type == Int16 && _channels == 1 && nativeOrder
+            && ((quintptr) _data & 1) == 0)
+        return reinterpret_cast<const short*>(_data);
+    return 0;
+}
+
+void SoundFileMapping::read( sf_count_t beginning, sf_count_t count, short *dest ) const
+{
+    Q_ASSERT(_data && beginning >= 0 && beginning + count <= _frames);
+
+    const uchar *src = _data + beginning * _channels * _bytesPerSample;
+
+    // Integer samples are truncated to their 16 most significant bits.
+    switch (_type)
+    {
+    case Int16:
+        if (_bigEndian)
+            readPlanar(src, _channels, 2, count, dest, []( const uchar *p ) {
+                return (short) qFromBigEndian<quint16>(p); });
+        else
+            readPlanar(src, _channels, 2, count, dest, []( const uchar *p ) {
+                return (short) qFromLittleEndian<quint16>(p); });
+        break;
+    case Int24:
+        if (_bigEndian)
+            readPlanar(src, _channels, 3, count, dest, []( const uchar *p ) {
+                return (short) (p[0] << 8 | p[1]); });
+        else
+            readPlanar(src, _channels, 3, count, dest, []( const uchar *p ) {
+                return (short) (p[2] << 8 | p[1]); });
+        break;
+    case Int32:
+        if (_bigEndian)
+            readPlanar(src, _channels, 4, count, dest, []( const uchar *p ) {
+                return (short) (p[0] << 8 | p[1]); });
+        else
+            readPlanar(src, _channels, 4, count, dest, []( const uchar *p ) {
+                return (short) (p[3] << 8 | p[2]); });
+        break;
+    case Float32:
+        if (_bigEndian)
+            readPlanar(src, _channels, 4, count, dest, []( const uchar *p ) {
+                return floatToShort(qFromBigEndian<quint32>(p)); });
+        else
+            readPlanar(src, _channels, 4, count, dest, []( const uchar *p ) {
+                return floatToShort(qFromLittleEndian<quint32>(p)); });
+        break;
+    }
+}
+
+void SoundFileMapping::read( sf_count_t beginning, sf_count_t count, float *dest ) const
+{
+    Q_ASSERT(_data && beginning >= 0 && beginning + count <= _frames);
+
+    const uchar *src = _data + beginning * _channels * _bytesPerSample;
+
+    switch (_type)
+    {
+    case Int16:
+        if (_bigEndian)
+            readPlanar(src, _channels, 2, count, dest, []( const uchar *p ) {
+                return (float) (short) qFromBigEndian<quint16>(p); });
+        else
+            readPlanar(src, _channels, 2, count, dest, []( const uchar *p ) {
+                return (float) (short) qFromLittleEndian<quint16>(p); });
+        break;
+    case Int24:
+        if (_bigEndian)
+            readPlanar(src, _channels, 3, count, dest, []( const uchar *p ) {
+                return (qint32) ((quint32) p[0] << 24 | p[1] << 16 | p[2] << 8) / 65536.f; });
+        else
+            readPlanar(src, _channels, 3, count, dest, []( const uchar *p ) {
+                return (qint32) ((quint32) p[2] << 24 | p[1] << 16 | p[0] << 8) / 65536.f; });
+        break;
+    case Int32:
+        if (_bigEndian)
+            readPlanar(src, _channels, 4, count, dest, []( const uchar *p ) {
+                return (qint32) qFromBigEndian<quint32>(p) / 65536.f; });
+        else
+            readPlanar(src, _channels, 4, count, dest, []( const uchar *p ) {
+                return (qint32) qFromLittleEndian<quint32>(p) / 65536.f; });
+        break;
+    case Float32:
+        if (_bigEndian)
+            readPlanar(src, _channels, 4, count, dest, []( const uchar *p ) {
+                return floatToScaled(qFromBigEndian<quint32>(p)); });
+        else
+            readPlanar(src, _channels, 4, count, dest, []( const uchar *p ) {
+                return floatToScaled(qFromLittleEndian<quint32>(p)); });
+        break;
+    }
+}
+
+bool SoundFileMapping::findData( const SF_INFO & info, qint64 *offset, qint64 *size )
+{
+    switch (info.format & SF_FORMAT_TYPEMASK)
+    {
+    case SF_FORMAT_WAV:
+    case SF_FORMAT_WAVEX:
+        return findWavData(offset, size);
+    case SF_FORMAT_AIFF:
+        return findAiffData(offset, size);
+    case SF_FORMAT_CAF:
+        return findCafData(offset, size);
+    default:
+        return false;
+    }
+}
+
+bool SoundFileMapping::findWavData( qint64 *offset, qint64 *size )
+{
+    _bigEndian = false;
+
+    QByteArray header = _file.read(12);
+    if (header.size() < 12 || !header.startsWith("RIFF") || header.mid(8, 4) != "WAVE")
+        return false;
+
+    qint64 pos = 12;
+    while (_file.seek(pos))
+    {
+        QByteArray chunk = _file.read(8);
+        if (chunk.size() < 8)
+            break;
+        quint32 chunkSize = qFromLittleEndian<quint32>((const uchar*) chunk.constData() + 4);
+        if (chunk.startsWith("data")) {
+            *offset = pos + 8;
+            *size = chunkSize;
+            return true;
+        }
+        pos += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    return false;
+}
+
+bool SoundFileMapping::findAiffData( qint64 *offset, qint64 *size )
+{
+    _bigEndian = true;
+
+    QByteArray header = _file.read(12);
+    if (header.size() < 12 || !header.startsWith("FORM"))
+        return false;
+    QByteArray formType = header.mid(8, 4);
+    if (formType != "AIFF" && formType != "AIFC")
+        return false;
+
+    bool found = false;
+    qint64 pos = 12;
+    while (_file.seek(pos))
+    {
+        QByteArray chunk = _file.read(8);
+        if (chunk.size() < 8)
+            break;
+        quint32 chunkSize = qFromBigEndian<quint32>((const uchar*) chunk.constData() + 4);
+
+        if (chunk.startsWith("COMM") && formType == "AIFC") {
+            QByteArray comm = _file.read(22);
+            if (comm.size() < 22)
+                return false;
+            QByteArray compression = comm.mid(18, 4);
+            if (compression == "sowt")
+                _bigEndian = false;
+            else if (compression != "NONE" && compression != "twos"
+                     && compression != "in24" && compression != "in32"
+                     && compression != "fl32" && compression != "FL32")
+                return false;
+        }
+        else if (chunk.startsWith("SSND")) {
+            QByteArray ssnd = _file.read(8);
+            if (ssnd.size() < 8)
+                return false;
+            quint32 dataOffset = qFromBigEndian<quint32>((const uchar*) ssnd.constData());
+            if (chunkSize < 8 + dataOffset)
+                return false;
+            *offset = pos + 16 + dataOffset;
+            *size = chunkSize - 8 - dataOffset;
+            found = true;
+        }
+
+        pos += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    return found;
+}
+
+bool SoundFileMapping::findCafData( qint64 *offset, qint64 *size )
+{
+    QByteArray header = _file.read(8);
+    if (header.size() < 8 || !header.startsWith("caff"))
+        return false;
+
+    bool described = false;
+    qint64 pos = 8;
+    while (_file.seek(pos))
+    {
+        QByteArray chunk = _file.read(12);
+        if (chunk.size() < 12)
+            break;
+        qint64 chunkSize = qFromBigEndian<qint64>((const uchar*) chunk.constData() + 4);
+
+        if (chunk.startsWith("desc")) {
+            QByteArray desc = _file.read(32);
+            if (desc.size() < 32 || desc.mid(8, 4) != "lpcm")
+                return false;
+            // kCAFLinearPCMFormatFlagIsLittleEndian
+            quint32 flags = qFromBigEndian<quint32>((const uchar*) desc.constData() + 12);
+            _bigEndian = !(flags & 2);
+            described = true;
+        }
+        else if (chunk.startsWith("data")) {
+            // Data follows an edit count, and may extend to the end of file.
+            *offset = pos + 12 + 4;
+            *size = chunkSize < 0 ? _file.size() - *offset : chunkSize - 4;
+            return described;
+        }
+
+        if (chunkSize < 0)
+            break;
+        pos += 12 + chunkSize;
+    }
+
+    return false;
+}
+
+} // namespace QuickCollider
@@ -0,0 +1,97 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SOUND_FILE_MAPPING_INCLUDED
+#define QUICK_COLLIDER_SOUND_FILE_MAPPING_INCLUDED
+
+#include <QString>
+#include <QFile>
+
+#include <sndfile.h>
+
+#include <algorithm>
+#include <climits>
+
+namespace QuickCollider {
+
+// Scales a float sample to the 16-bit range, clipping to [-1, 1]. Shared by
+// all readers of float data, so that they agree to the last bit.
+inline float scaleFloatSample( float value )
+{
+    return std::max( -1.f, std::min( 1.f, value ) ) * SHRT_MAX;
+}
+
+inline short floatSampleToShort( float value )
+{
+    return scaleFloatSample( value );
+}
+
+// Read-only memory mapping of the sample data of an uncompressed sound file,
+// so it can be read without going through libsndfile.
+//
+// Supports 16, 24 and 32 bit integer and 32 bit float samples in WAV, AIFF
+// (including uncompressed AIFC) and CAF files. The format is taken from the
+// SF_INFO that libsndfile parsed; only the position of the data is looked up
+// in the file itself. Anything else is left to libsndfile.
+//
+// Reading is thread-safe.
+
+class SoundFileMapping
+{
+public:
+    SoundFileMapping();
+    ~SoundFileMapping() { close(); }
+
+    // Returns false if the file is not supported, or can not be mapped.
+    bool open( const QString & path, const SF_INFO & info );
+    void close();
+    bool isOpen() const { return _data != 0; }
+
+    int channels() const { return _channels; }
+    sf_count_t frames() const { return _frames; }
+
+    // Samples of a single channel of native 16-bit data, which needs no conversion;
+    // otherwise 0.
+    const short *monoShortData() const;
+
+    // Converts 'count' frames from 'beginning' to 16 bits, as libsndfile would,
+    // into the planar 'dest' (channel after channel, 'count' samples each).
+    void read( sf_count_t beginning, sf_count_t count, short *dest ) const;
+    // Likewise without truncation: integer samples keep their bits below
+    // the 16 most significant ones as a fraction.
+    void read( sf_count_t beginning, sf_count_t count, float *dest ) const;
+
+private:
+    enum SampleType { Int16, Int24, Int32, Float32 };
+
+    bool findData( const SF_INFO & info, qint64 *offset, qint64 *size );
+    bool findWavData( qint64 *offset, qint64 *size );
+    bool findAiffData( qint64 *offset, qint64 *size );
+    bool findCafData( qint64 *offset, qint64 *size );
+
+    QFile _file;
+    uchar *_data;
+    SampleType _type;
+    int _bytesPerSample;
+    bool _bigEndian;
+    int _channels;
+    sf_count_t _frames;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SOUND_FILE_MAPPING_INCLUDED
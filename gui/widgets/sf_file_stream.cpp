@@ -20,69 +20,278 @@
 ************************************************************************/
 
 #include "sf_view.hpp"
-#include <limits>
+#include "sf_kernels.hpp"
 #include <cmath>
 
 namespace QuickCollider {
 
-SoundFileStream::SoundFileStream() : _data(0), _dataSize(0), _dataOffset(0)
+// Adds 'count' samples to 'sums'; vectorized for 16-bit samples.
+static inline void sampleSums( const SoundKernels &, const float *samples, int count,
+                               SoundColumnSums & sums )
+{
+  for( int i = 0; i < count; ++i ) {
+    float value = samples[i];
+    sums.add( value, value, value, value * value );
+  }
+}
+static inline void sampleSums( const SoundKernels & kernels, const short *samples, int count,
+                               SoundColumnSums & sums )
+{
+  SoundSums s = { SHRT_MAX, SHRT_MIN, 0.0, 0.0 };
+  kernels.sampleSums( samples, count, s );
+  sums.add( s.min, s.max, s.sum, s.sum_of_squares );
+}
+
+// Adds 'count' samples, the first weighted by frac0, the last by frac1.
+template <typename T>
+static inline void weightedSums( const SoundKernels & kernels, const T *samples, int count,
+                                 float frac0, float frac1, SoundColumnSums & sums )
+{
+  if( count < 1 ) return;
+
+  float first = samples[0];
+  sums.add( first, first, first * frac0, first * first * frac0 );
+
+  if( count < 2 ) return;
+
+  sampleSums( kernels, samples + 1, count - 2, sums );
+
+  float last = samples[count - 1];
+  sums.add( last, last, last * frac1, last * last * frac1 );
+}
+
+// Reduces each run of 'frames' samples to one unit; vectorized for 16-bit samples.
+static void unitSums( const SoundKernels & kernels, const float *data, int units, int frames,
+                      float *min, float *max, float *sum, float *sum2 )
+{
+  for( int u = 0; u < units; ++u, data += frames ) {
+    SoundColumnSums sums = { data[0], data[0], 0.0, 0.0 };
+    sampleSums( kernels, data, frames, sums );
+    min[u] = sums.min;
+    max[u] = sums.max;
+    sum[u] = sums.sum;
+    sum2[u] = sums.sum_of_squares;
+  }
+}
+static void unitSums( const SoundKernels & kernels, const short *data, int units, int frames,
+                      float *min, float *max, float *sum, float *sum2 )
+{
+  // The kernel's 16-bit extremes pass through a small buffer.
+  const int blockSize = 256;
+  short blockMin[blockSize];
+  short blockMax[blockSize];
+  for( int u = 0; u < units; u += blockSize ) {
+    int n = std::min( blockSize, units - u );
+    kernels.unitSums( data + (sf_count_t) u * frames, n, frames,
+                      blockMin, blockMax, sum + u, sum2 + u );
+    std::copy( blockMin, blockMin + n, min + u );
+    std::copy( blockMax, blockMax + n, max + u );
+  }
+}
+
+SoundFileStream::SoundFileStream() :
+  _data(0), _floatSamples(0), _dataSize(0), _dataOffset(0),
+  _buffer(0), _capacity(0), _floatBuffer(0), _floatBufferCapacity(0),
+  _floatData(0), _floatCapacity(0),
+  _interleavedData(0), _interleavedCapacity(0)
 {}
 
 SoundFileStream::SoundFileStream( SNDFILE *sf, const SF_INFO &info, sf_count_t b, sf_count_t d )
-: _data(0)
+: _data(0), _floatSamples(0),
+  _buffer(0), _capacity(0), _floatBuffer(0), _floatBufferCapacity(0),
+  _floatData(0), _floatCapacity(0),
+  _interleavedData(0), _interleavedCapacity(0)
 {
   load( sf, info, b, d );
 }
 
 SoundFileStream::~SoundFileStream()
 {
-  delete[] _data;
+  delete[] _buffer;
+  delete[] _floatBuffer;
+  delete[] _floatData;
+  delete[] _interleavedData;
 }
 
-void SoundFileStream::load( SNDFILE *sf, const SF_INFO &info, sf_count_t beg, sf_count_t dur )
+void SoundFileStream::load( SNDFILE *sf, const SF_INFO &info, sf_count_t beg, sf_count_t dur,
+                            bool floatSamples )
 {
-  delete[] _data;
-
   _dataOffset = beg;
   _dataSize = dur;
 
-  _data = new short [_dataSize * info.channels];
+  sf_count_t sampleCount = _dataSize * info.channels;
   sf_seek( sf, _dataOffset, SEEK_SET);
 
-  if (info.format & SF_FORMAT_FLOAT || info.format & SF_FORMAT_DOUBLE)
+  // Stored planar, so that the samples of a channel are contiguous.
+  int channels = info.channels;
+
+  int subformat = info.format & SF_FORMAT_SUBMASK;
+  bool floatFormat = subformat == SF_FORMAT_FLOAT || subformat == SF_FORMAT_DOUBLE;
+
+  if( floatSamples || floatFormat )
   {
     // libsndfile reading float into short is broken for non-power-of-two channel counts
-    int sampleCount = _dataSize * info.channels;
-    float *tmp = new float [sampleCount];
-    _dataSize = sf_readf_float( sf, tmp, _dataSize );
-    for (int i = 0; i < sampleCount; ++i)
-        _data[i] = std::max( -1.f, std::min( 1.f, tmp[i] ) ) * std::numeric_limits<short>::max();
-    delete[] tmp;
+    if( sampleCount > _floatCapacity ) {
+      delete[] _floatData;
+      _floatData = new float [sampleCount];
+      _floatCapacity = sampleCount;
+    }
+    _dataSize = sf_readf_float( sf, _floatData, _dataSize );
   }
-  else
+
+  if( floatSamples )
+  {
+    reserveFloats( sampleCount );
+    _floatSamples = _floatBuffer;
+    _data = 0;
+    // libsndfile scales integers to [-1, 1) by their full range,
+    // in which the 16-bit range is 32768.
+    for( int ch = 0; ch < channels; ++ch ) {
+      const float *src = _floatData + ch;
+      float *dst = _floatSamples + ch * _dataSize;
+      if( floatFormat ) {
+        for( sf_count_t f = 0; f < _dataSize; ++f, src += channels )
+          dst[f] = scaleFloatSample( *src );
+      }
+      else {
+        for( sf_count_t f = 0; f < _dataSize; ++f, src += channels )
+          dst[f] = *src * 32768.f;
+      }
+    }
+  }
+  else if( floatFormat )
+  {
+    reserve( sampleCount );
+    _data = _buffer;
+    _floatSamples = 0;
+    for( int ch = 0; ch < channels; ++ch ) {
+      const float *src = _floatData + ch;
+      short *dst = _data + ch * _dataSize;
+      for( sf_count_t f = 0; f < _dataSize; ++f, src += channels )
+        dst[f] = floatSampleToShort( *src );
+    }
+  }
+  else if( channels == 1 )
   {
+    reserve( sampleCount );
+    _data = _buffer;
+    _floatSamples = 0;
     _dataSize = sf_readf_short( sf, _data, _dataSize );
   }
+  else
+  {
+    reserve( sampleCount );
+    _data = _buffer;
+    _floatSamples = 0;
+    if( sampleCount > _interleavedCapacity ) {
+      delete[] _interleavedData;
+      _interleavedData = new short [sampleCount];
+      _interleavedCapacity = sampleCount;
+    }
+    _dataSize = sf_readf_short( sf, _interleavedData, _dataSize );
+    for( int ch = 0; ch < channels; ++ch ) {
+      const short *src = _interleavedData + ch;
+      short *dst = _data + ch * _dataSize;
+      for( sf_count_t f = 0; f < _dataSize; ++f, src += channels )
+        dst[f] = *src;
+    }
+  }
 
   _ch = info.channels;
   _beg = _dataOffset;
   _dur = _dataSize;
 }
 
+void SoundFileStream::load( const SoundFileMapping & mapping, sf_count_t beg, sf_count_t dur,
+                            bool floatSamples )
+{
+  _dataOffset = beg;
+  _dataSize = dur;
+
+  const short *mono = floatSamples ? 0 : mapping.monoShortData();
+  if( floatSamples ) {
+    reserveFloats( dur * mapping.channels() );
+    _floatSamples = _floatBuffer;
+    _data = 0;
+    mapping.read( beg, dur, _floatSamples );
+  }
+  else if( mono ) {
+    // The mapping is copy-on-write, and never written through here anyway.
+    _data = const_cast<short*>( mono ) + beg;
+    _floatSamples = 0;
+  }
+  else {
+    reserve( dur * mapping.channels() );
+    _data = _buffer;
+    _floatSamples = 0;
+    mapping.read( beg, dur, _data );
+  }
+
+  _ch = mapping.channels();
+  _beg = _dataOffset;
+  _dur = _dataSize;
+}
+
+void SoundFileStream::reserve( sf_count_t sampleCount )
+{
+  if( sampleCount > _capacity ) {
+    delete[] _buffer;
+    _buffer = new short [sampleCount];
+    _capacity = sampleCount;
+  }
+}
+
+void SoundFileStream::reserveFloats( sf_count_t sampleCount )
+{
+  if( sampleCount > _floatBufferCapacity ) {
+    delete[] _floatBuffer;
+    _floatBuffer = new float [sampleCount];
+    _floatBufferCapacity = sampleCount;
+  }
+}
+
+bool SoundFileStream::covers( int ch, double f_beg, double f_dur )
+{
+  return ( _data != 0 || _floatSamples != 0 )
+         && ch < channels()
+         && ( f_beg >= beginning() )
+         && ( f_beg + f_dur <= beginning() + duration() );
+}
+
 bool SoundFileStream::integrate
 ( int ch, double f_beg, double f_dur,
-  short *minBuffer, short *maxBuffer, float *sumBuf, float *sum2Buf, int bufferSize )
+  float *minBuffer, float *maxBuffer, float *sumBuf, float *sum2Buf, int bufferSize )
 {
-  bool ok = _data != 0
-            && ch < channels()
-            && ( f_beg >= beginning() )
-            && ( f_beg + f_dur <= beginning() + duration() );
-  if( !ok ) return false;
+  if( !covers( ch, f_beg, f_dur ) ) return false;
+
+  if( _floatSamples )
+    integrateAs( _floatSamples + ch * _dataSize, f_beg, f_dur,
+                 minBuffer, maxBuffer, sumBuf, sum2Buf, bufferSize );
+  else
+    integrateAs( _data + ch * _dataSize, f_beg, f_dur,
+                 minBuffer, maxBuffer, sumBuf, sum2Buf, bufferSize );
+  return true;
+}
+
+template <typename T>
+void SoundFileStream::integrateAs
+( const T *data, double f_beg, double f_dur,
+  float *minBuffer, float *maxBuffer, float *sumBuf, float *sum2Buf, int bufferSize )
+{
+  const SoundKernels & kernels = SoundKernels::get();
 
   double fpu = f_dur / bufferSize;
   double f_pos = f_beg - _dataOffset;
   double f_pos_max = _dataSize;
 
+  // Whole frames per unit, beginning at a frame, as when building the cache.
+  int frames = fpu;
+  if( frames > 0 && frames == fpu && f_pos == std::floor(f_pos) ) {
+    unitSums( kernels, data + (sf_count_t) f_pos, bufferSize, frames,
+              minBuffer, maxBuffer, sumBuf, sum2Buf );
+    return;
+  }
+
   int i;
   for( i = 0; i < bufferSize; ++i ) {
     int data_pos = std::floor(f_pos);
@@ -103,54 +312,47 @@ bool SoundFileStream::integrate
     float frac1 = f_pos1 + 1.f - std::ceil(f_pos1);
 
     // get min, max and sum
-    short *samples = _data + (data_pos * channels()) + ch;
-    short min = SHRT_MAX;
-    short max = SHRT_MIN;
-    float sum = 0.f;
-    float sum2 = 0.f;
-    int f; // frame
-    for( f = 0; f < frame_count; ++f, samples += channels() ){
     // TODO should we overlap min-max or not here?
-      float sample = *samples;
-      float frac;
-      if( f == 0 ) frac = frac0;
-      else if( f == frame_count - 1 ) frac = frac1;
-      else frac = 1.0;
+    SoundColumnSums sums = { SHRT_MAX, SHRT_MIN, 0.0, 0.0 };
+    weightedSums( kernels, data + data_pos, frame_count, frac0, frac1, sums );
 
-      if( sample < min ) min = sample;
-      if( sample > max ) max = sample;
-
-      sum += sample * frac;
-      sum2 += sample * sample * frac;
-    }
-
-    minBuffer[i] = min;
-    maxBuffer[i] = max;
-    sumBuf[i] = sum;
-    sum2Buf[i] = sum2;
+    minBuffer[i] = sums.min;
+    maxBuffer[i] = sums.max;
+    sumBuf[i] = sums.sum;
+    sum2Buf[i] = sums.sum_of_squares;
 
     f_pos = f_pos1;
   }
-
-  return true;
 }
 
 bool SoundFileStream::displayData
 ( int ch, double f_beg, double f_dur,
-  short *minBuffer, short *maxBuffer, short *minRMS, short *maxRMS, int bufferSize )
+  float *minBuffer, float *maxBuffer, float *minRMS, float *maxRMS, int bufferSize )
 {
-  bool ok = _data != 0
-            && ch < channels()
-            && ( f_beg >= beginning() )
-            && ( f_beg + f_dur <= beginning() + duration() );
-  if( !ok ) return false;
+  if( !covers( ch, f_beg, f_dur ) ) return false;
+
+  if( _floatSamples )
+    displayDataAs( _floatSamples + ch * _dataSize, f_beg, f_dur,
+                   minBuffer, maxBuffer, minRMS, maxRMS, bufferSize );
+  else
+    displayDataAs( _data + ch * _dataSize, f_beg, f_dur,
+                   minBuffer, maxBuffer, minRMS, maxRMS, bufferSize );
+  return true;
+}
+
+template <typename T>
+void SoundFileStream::displayDataAs
+( const T *data, double f_beg, double f_dur,
+  float *minBuffer, float *maxBuffer, float *minRMS, float *maxRMS, int bufferSize )
+{
+  const SoundKernels & kernels = SoundKernels::get();
 
   double fpu = f_dur / bufferSize;
   double f_pos = f_beg - _dataOffset;
   double f_pos_max = _dataSize;
 
-  short min = SHRT_MAX;
-  short max = SHRT_MIN;
+  float min = SHRT_MAX;
+  float max = SHRT_MIN;
 
   double D_SHRT_MAX = (double) SHRT_MAX;
   double D_SHRT_MIN = (double) SHRT_MIN;
@@ -175,32 +377,16 @@ bool SoundFileStream::displayData
     float frac1 = f_pos1 + 1.f - std::ceil(f_pos1);
 
     // get min, max and sum
-    short *samples = _data + (data_pos * channels()) + ch;
-
-    float sum = 0.f;
-    float sum2 = 0.f;
-    int f; // frame
-    for( f = 0; f < frame_count; ++f, samples += channels() ){
-      // TODO should we overlap min-max or not here?
-      float sample = *samples;
-      float frac;
-      if( f == 0 ) frac = frac0;
-      else if( f == frame_count - 1 ) frac = frac1;
-      else frac = 1.0;
-
-      if( sample < min ) min = sample;
-      if( sample > max ) max = sample;
-
-      sum += sample * frac;
-      sum2 += sample * sample * frac;
-    }
+    // TODO should we overlap min-max or not here?
+    SoundColumnSums sums = { min, max, 0.0, 0.0 };
+    weightedSums( kernels, data + data_pos, frame_count, frac0, frac1, sums );
 
     double n = fpu;
-    double avg = sum / n;
-    double stdDev = std::sqrt( abs((sum2 - (sum*avg) ) / n) );
+    double avg = sums.sum / n;
+    double stdDev = std::sqrt( std::abs((sums.sum_of_squares - (sums.sum*avg) ) / n) );
 
-    minBuffer[i] = min;
-    maxBuffer[i] = max;
+    minBuffer[i] = sums.min;
+    maxBuffer[i] = sums.max;
     minRMS[i] = std::max(D_SHRT_MIN, std::min(D_SHRT_MAX, avg - stdDev ));
     maxRMS[i] = std::max(D_SHRT_MIN, std::min(D_SHRT_MAX, avg + stdDev ));
 
@@ -208,16 +394,19 @@ bool SoundFileStream::displayData
     min = maxBuffer[i];
     max = minBuffer[i];
   }
-
-  return true;
 }
 
-short *SoundFileStream::rawFrames( int ch, sf_count_t b, sf_count_t d, bool *interleaved )
+const float *SoundFileStream::rawFrames( int ch, sf_count_t b, sf_count_t d, bool *interleaved )
 {
   if( ch > channels() || b < _dataOffset || b + d > _dataOffset + _dataSize ) return 0;
-  *interleaved = true;
-  sf_count_t offset = (b - _dataOffset) * channels() + ch;
-  return ( _data + offset );
+  *interleaved = false;
+  sf_count_t offset = ch * _dataSize + (b - _dataOffset);
+  if( _floatSamples )
+    return _floatSamples + offset;
+
+  // Valid until the next call.
+  _rawFrames.assign( _data + offset, _data + offset + d );
+  return _rawFrames.data();
 }
 
 } // namespace QuickCollider
@@ -0,0 +1,424 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sf_kernels.hpp"
+
+#include <climits>
+
+#if QC_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace QuickCollider {
+
+namespace {
+
+// Scalar
+
+// Continues reduction of data[begin..count), with running values passed by reference.
+inline void continueSamples( const short * data, int begin, int count,
+                             short & min, short & max, float & sum, float & sum_sq )
+{
+    for (int idx = begin; idx < count; ++idx) {
+        short value = data[idx];
+        if (value < min) min = value;
+        if (value > max) max = value;
+        float f = value;
+        sum += f;
+        sum_sq += f * f;
+    }
+}
+
+// One unit per sample.
+inline void continueCopy( const short * data, int begin, int count,
+                          short * min, short * max, float * sum, float * sum_sq )
+{
+    for (int idx = begin; idx < count; ++idx) {
+        short value = data[idx];
+        float f = value;
+        min[idx] = value;
+        max[idx] = value;
+        sum[idx] = f;
+        sum_sq[idx] = f * f;
+    }
+}
+
+inline void continueUnits( const short * min, const short * max,
+                           const float * sum, const float * sum_sq, int begin, int count,
+                           SoundSums & out )
+{
+    for (int idx = begin; idx < count; ++idx) {
+        if (min[idx] < out.min) out.min = min[idx];
+        if (max[idx] > out.max) out.max = max[idx];
+        out.sum += sum[idx];
+        out.sum_of_squares += sum_sq[idx];
+    }
+}
+
+void sampleSumsScalar( const short * data, int count, SoundSums & out )
+{
+    float sum = 0.f, sum_sq = 0.f;
+    continueSamples( data, 0, count, out.min, out.max, sum, sum_sq );
+    out.sum += sum;
+    out.sum_of_squares += sum_sq;
+}
+
+void unitSumsScalar( const short * data, int units, int frames,
+                     short * min, short * max, float * sum, float * sum_sq )
+{
+    if (frames == 1) {
+        continueCopy( data, 0, units, min, max, sum, sum_sq );
+        return;
+    }
+    for (int unit = 0; unit < units; ++unit, data += frames) {
+        short unit_min = SHRT_MAX, unit_max = SHRT_MIN;
+        float unit_sum = 0.f, unit_sum_sq = 0.f;
+        continueSamples( data, 0, frames, unit_min, unit_max, unit_sum, unit_sum_sq );
+        min[unit] = unit_min;
+        max[unit] = unit_max;
+        sum[unit] = unit_sum;
+        sum_sq[unit] = unit_sum_sq;
+    }
+}
+
+void cacheSumsScalar( const short * min, const short * max,
+                      const float * sum, const float * sum_sq, int count, SoundSums & out )
+{
+    continueUnits( min, max, sum, sum_sq, 0, count, out );
+}
+
+#if QC_SIMD_X86
+
+// SSE2
+
+QC_TARGET_SSE2
+inline short horizontalMinSse2( __m128i v )
+{
+    v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_min_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (short) _mm_cvtsi128_si32(v);
+}
+
+QC_TARGET_SSE2
+inline short horizontalMaxSse2( __m128i v )
+{
+    v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (short) _mm_cvtsi128_si32(v);
+}
+
+QC_TARGET_SSE2
+inline float horizontalSumSse2( __m128 v )
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+QC_TARGET_SSE2
+inline double horizontalSumSse2( __m128d v )
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+// Sign-extends 8 samples into two vectors of 4 floats.
+QC_TARGET_SSE2
+inline void toFloatSse2( __m128i v, __m128 & lo, __m128 & hi )
+{
+    lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+}
+
+QC_TARGET_SSE2
+inline void reduceSamplesSse2( const short * data, int count,
+                               short & min, short & max, float & sum, float & sum_sq )
+{
+    int idx = 0;
+    if (count >= 8)
+    {
+        __m128i vmin = _mm_set1_epi16(min);
+        __m128i vmax = _mm_set1_epi16(max);
+        __m128 vsum = _mm_setzero_ps();
+        __m128 vsum_sq = _mm_setzero_ps();
+        for (; idx + 8 <= count; idx += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + idx));
+            vmin = _mm_min_epi16(vmin, v);
+            vmax = _mm_max_epi16(vmax, v);
+            __m128 lo, hi;
+            toFloatSse2(v, lo, hi);
+            vsum = _mm_add_ps(vsum, _mm_add_ps(lo, hi));
+            vsum_sq = _mm_add_ps(vsum_sq, _mm_add_ps(_mm_mul_ps(lo, lo), _mm_mul_ps(hi, hi)));
+        }
+        min = horizontalMinSse2(vmin);
+        max = horizontalMaxSse2(vmax);
+        sum += horizontalSumSse2(vsum);
+        sum_sq += horizontalSumSse2(vsum_sq);
+    }
+    continueSamples( data, idx, count, min, max, sum, sum_sq );
+}
+
+QC_TARGET_SSE2
+void sampleSumsSse2( const short * data, int count, SoundSums & out )
+{
+    float sum = 0.f, sum_sq = 0.f;
+    reduceSamplesSse2( data, count, out.min, out.max, sum, sum_sq );
+    out.sum += sum;
+    out.sum_of_squares += sum_sq;
+}
+
+QC_TARGET_SSE2
+void unitSumsSse2( const short * data, int units, int frames,
+                   short * min, short * max, float * sum, float * sum_sq )
+{
+    if (frames == 1) {
+        int idx = 0;
+        for (; idx + 8 <= units; idx += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + idx));
+            _mm_storeu_si128((__m128i*)(min + idx), v);
+            _mm_storeu_si128((__m128i*)(max + idx), v);
+            __m128 lo, hi;
+            toFloatSse2(v, lo, hi);
+            _mm_storeu_ps(sum + idx, lo);
+            _mm_storeu_ps(sum + idx + 4, hi);
+            _mm_storeu_ps(sum_sq + idx, _mm_mul_ps(lo, lo));
+            _mm_storeu_ps(sum_sq + idx + 4, _mm_mul_ps(hi, hi));
+        }
+        continueCopy( data, idx, units, min, max, sum, sum_sq );
+        return;
+    }
+    for (int unit = 0; unit < units; ++unit, data += frames) {
+        short unit_min = SHRT_MAX, unit_max = SHRT_MIN;
+        float unit_sum = 0.f, unit_sum_sq = 0.f;
+        reduceSamplesSse2( data, frames, unit_min, unit_max, unit_sum, unit_sum_sq );
+        min[unit] = unit_min;
+        max[unit] = unit_max;
+        sum[unit] = unit_sum;
+        sum_sq[unit] = unit_sum_sq;
+    }
+}
+
+// Sums are accumulated as doubles, as units may hold large sums of squares.
+QC_TARGET_SSE2
+void cacheSumsSse2( const short * min, const short * max,
+                    const float * sum, const float * sum_sq, int count, SoundSums & out )
+{
+    int idx = 0;
+    if (count >= 8)
+    {
+        __m128i vmin = _mm_set1_epi16(out.min);
+        __m128i vmax = _mm_set1_epi16(out.max);
+        __m128d vsum = _mm_setzero_pd();
+        __m128d vsum_sq = _mm_setzero_pd();
+        for (; idx + 8 <= count; idx += 8) {
+            vmin = _mm_min_epi16(vmin, _mm_loadu_si128((const __m128i*)(min + idx)));
+            vmax = _mm_max_epi16(vmax, _mm_loadu_si128((const __m128i*)(max + idx)));
+            for (int part = 0; part < 8; part += 4) {
+                __m128 s = _mm_loadu_ps(sum + idx + part);
+                __m128 sq = _mm_loadu_ps(sum_sq + idx + part);
+                vsum = _mm_add_pd(vsum, _mm_add_pd(_mm_cvtps_pd(s), _mm_cvtps_pd(_mm_movehl_ps(s, s))));
+                vsum_sq = _mm_add_pd(vsum_sq, _mm_add_pd(_mm_cvtps_pd(sq), _mm_cvtps_pd(_mm_movehl_ps(sq, sq))));
+            }
+        }
+        out.min = horizontalMinSse2(vmin);
+        out.max = horizontalMaxSse2(vmax);
+        out.sum += horizontalSumSse2(vsum);
+        out.sum_of_squares += horizontalSumSse2(vsum_sq);
+    }
+    continueUnits( min, max, sum, sum_sq, idx, count, out );
+}
+
+// AVX2
+
+QC_TARGET_AVX2
+inline void toFloatAvx2( __m256i v, __m256 & lo, __m256 & hi )
+{
+    lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+    hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+}
+
+QC_TARGET_AVX2
+inline __m128 foldAvx2( __m256 v )
+{
+    return _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+}
+
+QC_TARGET_AVX2
+inline __m128d foldAvx2( __m256d v )
+{
+    return _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+}
+
+QC_TARGET_AVX2
+inline void reduceSamplesAvx2( const short * data, int count,
+                               short & min, short & max, float & sum, float & sum_sq )
+{
+    int idx = 0;
+    if (count >= 16)
+    {
+        __m256i vmin = _mm256_set1_epi16(min);
+        __m256i vmax = _mm256_set1_epi16(max);
+        __m256 vsum = _mm256_setzero_ps();
+        __m256 vsum_sq = _mm256_setzero_ps();
+        for (; idx + 16 <= count; idx += 16) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(data + idx));
+            vmin = _mm256_min_epi16(vmin, v);
+            vmax = _mm256_max_epi16(vmax, v);
+            __m256 lo, hi;
+            toFloatAvx2(v, lo, hi);
+            vsum = _mm256_add_ps(vsum, _mm256_add_ps(lo, hi));
+            vsum_sq = _mm256_add_ps(vsum_sq, _mm256_add_ps(_mm256_mul_ps(lo, lo), _mm256_mul_ps(hi, hi)));
+        }
+        min = horizontalMinSse2(_mm_min_epi16(_mm256_castsi256_si128(vmin),
+                                              _mm256_extracti128_si256(vmin, 1)));
+        max = horizontalMaxSse2(_mm_max_epi16(_mm256_castsi256_si128(vmax),
+                                              _mm256_extracti128_si256(vmax, 1)));
+        sum += horizontalSumSse2(foldAvx2(vsum));
+        sum_sq += horizontalSumSse2(foldAvx2(vsum_sq));
+    }
+    continueSamples( data, idx, count, min, max, sum, sum_sq );
+}
+
+QC_TARGET_AVX2
+void sampleSumsAvx2( const short * data, int count, SoundSums & out )
+{
+    float sum = 0.f, sum_sq = 0.f;
+    reduceSamplesAvx2( data, count, out.min, out.max, sum, sum_sq );
+    out.sum += sum;
+    out.sum_of_squares += sum_sq;
+}
+
+QC_TARGET_AVX2
+void unitSumsAvx2( const short * data, int units, int frames,
+                   short * min, short * max, float * sum, float * sum_sq )
+{
+    if (frames == 1) {
+        int idx = 0;
+        for (; idx + 16 <= units; idx += 16) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(data + idx));
+            _mm256_storeu_si256((__m256i*)(min + idx), v);
+            _mm256_storeu_si256((__m256i*)(max + idx), v);
+            __m256 lo, hi;
+            toFloatAvx2(v, lo, hi);
+            _mm256_storeu_ps(sum + idx, lo);
+            _mm256_storeu_ps(sum + idx + 8, hi);
+            _mm256_storeu_ps(sum_sq + idx, _mm256_mul_ps(lo, lo));
+            _mm256_storeu_ps(sum_sq + idx + 8, _mm256_mul_ps(hi, hi));
+        }
+        continueCopy( data, idx, units, min, max, sum, sum_sq );
+        return;
+    }
+    // Short units are left to SSE2, as AVX2 needs 16 samples per step.
+    if (frames < 16) {
+        unitSumsSse2( data, units, frames, min, max, sum, sum_sq );
+        return;
+    }
+    for (int unit = 0; unit < units; ++unit, data += frames) {
+        short unit_min = SHRT_MAX, unit_max = SHRT_MIN;
+        float unit_sum = 0.f, unit_sum_sq = 0.f;
+        reduceSamplesAvx2( data, frames, unit_min, unit_max, unit_sum, unit_sum_sq );
+        min[unit] = unit_min;
+        max[unit] = unit_max;
+        sum[unit] = unit_sum;
+        sum_sq[unit] = unit_sum_sq;
+    }
+}
+
+QC_TARGET_AVX2
+void cacheSumsAvx2( const short * min, const short * max,
+                    const float * sum, const float * sum_sq, int count, SoundSums & out )
+{
+    int idx = 0;
+    if (count >= 16)
+    {
+        __m256i vmin = _mm256_set1_epi16(out.min);
+        __m256i vmax = _mm256_set1_epi16(out.max);
+        __m256d vsum = _mm256_setzero_pd();
+        __m256d vsum_sq = _mm256_setzero_pd();
+        for (; idx + 16 <= count; idx += 16) {
+            vmin = _mm256_min_epi16(vmin, _mm256_loadu_si256((const __m256i*)(min + idx)));
+            vmax = _mm256_max_epi16(vmax, _mm256_loadu_si256((const __m256i*)(max + idx)));
+            for (int part = 0; part < 16; part += 4) {
+                vsum = _mm256_add_pd(vsum, _mm256_cvtps_pd(_mm_loadu_ps(sum + idx + part)));
+                vsum_sq = _mm256_add_pd(vsum_sq, _mm256_cvtps_pd(_mm_loadu_ps(sum_sq + idx + part)));
+            }
+        }
+        out.min = horizontalMinSse2(_mm_min_epi16(_mm256_castsi256_si128(vmin),
+                                                  _mm256_extracti128_si256(vmin, 1)));
+        out.max = horizontalMaxSse2(_mm_max_epi16(_mm256_castsi256_si128(vmax),
+                                                  _mm256_extracti128_si256(vmax, 1)));
+        out.sum += horizontalSumSse2(foldAvx2(vsum));
+        out.sum_of_squares += horizontalSumSse2(foldAvx2(vsum_sq));
+    }
+    continueUnits( min, max, sum, sum_sq, idx, count, out );
+}
+
+#endif // QC_SIMD_X86
+
+const SoundKernels scalarKernels = {
+    &sampleSumsScalar,
+    &unitSumsScalar,
+    &cacheSumsScalar,
+    ScalarInstructions
+};
+
+#if QC_SIMD_X86
+
+const SoundKernels sse2Kernels = {
+    &sampleSumsSse2,
+    &unitSumsSse2,
+    &cacheSumsSse2,
+    Sse2Instructions
+};
+
+const SoundKernels avx2Kernels = {
+    &sampleSumsAvx2,
+    &unitSumsAvx2,
+    &cacheSumsAvx2,
+    Avx2Instructions
+};
+
+#endif
+
+} // namespace
+
+const SoundKernels * SoundKernels::get( InstructionSet isa )
+{
+    if (!cpuSupports(isa))
+        return 0;
+
+    switch (isa)
+    {
+#if QC_SIMD_X86
+    case Sse2Instructions:
+        return &sse2Kernels;
+    case Avx2Instructions:
+        return &avx2Kernels;
+#endif
+    default:
+        return &scalarKernels;
+    }
+}
+
+const SoundKernels & SoundKernels::get()
+{
+    static const SoundKernels * kernels = get( bestInstructionSet() );
+    return *kernels;
+}
+
+} // namespace QuickCollider
@@ -0,0 +1,64 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SOUND_KERNELS_INCLUDED
+#define QUICK_COLLIDER_SOUND_KERNELS_INCLUDED
+
+#include "../../utility/cpu_features.hpp"
+
+// NOTE: This file must not depend on Qt, so that it can be built into benchmarks.
+
+namespace QuickCollider {
+
+// Loops reducing planar 16-bit sound data, and sound cache units made from it,
+// to min, max, sum and sum of squares, as drawn by SoundFileView.
+
+struct SoundSums
+{
+    short min;
+    short max;
+    double sum;
+    double sum_of_squares;
+};
+
+struct SoundKernels
+{
+    // Adds 'count' samples to 'sums'. Any count >= 0.
+    void (*sampleSums)( const short * data, int count, SoundSums & sums );
+
+    // Reduces each run of 'frames' samples to one unit: units * frames samples in total.
+    // Requires frames > 0.
+    void (*unitSums)( const short * data, int units, int frames,
+                      short * min, short * max, float * sum, float * sum_of_squares );
+
+    // Adds 'count' units to 'sums'. Any count >= 0.
+    void (*cacheSums)( const short * min, const short * max,
+                       const float * sum, const float * sum_of_squares,
+                       int count, SoundSums & sums );
+
+    InstructionSet isa;
+
+    // Kernels for the best instruction set supported by this CPU.
+    static const SoundKernels & get();
+
+    // Kernels for a specific instruction set, or 0 if the CPU does not support it.
+    static const SoundKernels * get( InstructionSet );
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SOUND_KERNELS_INCLUDED
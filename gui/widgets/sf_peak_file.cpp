@@ -0,0 +1,222 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sf_peak_file.hpp"
+
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QSaveFile>
+#include <QDebug>
+
+#include <cstring>
+
+namespace QuickCollider {
+
+namespace {
+
+const char peakFileMagic[8] = { 'Q', 'C', 'P', 'E', 'A', 'K', 'S', 0 };
+// Increase whenever the header or the storage layout of SoundCacheStream changes.
+const quint32 peakFileVersion = 2;
+// Peak files are not portable between byte orders.
+const quint32 byteOrderMark = 0x01020304;
+// Stored data starts at a multiple of this, so it is aligned when mapped.
+const qint64 dataAlignment = 64;
+
+struct PeakFileHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    qint64 fileSize;
+    qint64 modified;
+    qint64 beginning;
+    qint64 duration;
+    qint32 channels;
+    qint32 fpu;
+    qint64 dataOffset;
+    qint64 dataSize;
+    quint64 checksum;
+    qint32 pathSize;
+    qint32 precision;
+};
+
+qint64 dataOffset( qint64 pathSize )
+{
+    qint64 offset = sizeof(PeakFileHeader) + pathSize;
+    return (offset + dataAlignment - 1) / dataAlignment * dataAlignment;
+}
+
+// FNV-1a over 64-bit words, and then the remaining bytes.
+quint64 checksum( const char *data, qint64 size )
+{
+    const quint64 prime = 1099511628211ULL;
+    quint64 hash = 14695981039346656037ULL;
+    qint64 words = size / 8;
+    for (qint64 i = 0; i < words; ++i) {
+        quint64 word;
+        memcpy( &word, data + i * 8, 8 );
+        hash = (hash ^ word) * prime;
+    }
+    for (qint64 i = words * 8; i < size; ++i)
+        hash = (hash ^ (uchar) data[i]) * prime;
+    return hash;
+}
+
+} // namespace
+
+bool SoundPeakFile::Key::setSource( const QString & filename )
+{
+    QFileInfo info(filename);
+    if (!info.isFile())
+        return false;
+    path = info.absoluteFilePath();
+    fileSize = info.size();
+    modified = info.lastModified().toMSecsSinceEpoch();
+    return true;
+}
+
+QString SoundPeakFile::location( const Key & key )
+{
+    if (key.path.isEmpty())
+        return QString();
+
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (dir.isEmpty())
+        return QString();
+
+    QString id = QString("%1\n%2\n%3\n%4\n%5\n%6\n%7")
+            .arg(key.path).arg(key.fileSize).arg(key.modified)
+            .arg(key.beginning).arg(key.duration).arg(key.fpu).arg(key.precision);
+    QByteArray hash = QCryptographicHash::hash(id.toUtf8(), QCryptographicHash::Sha1);
+
+    return dir + "/peaks/" + QString::fromLatin1(hash.toHex()) + ".qcpeaks";
+}
+
+bool SoundPeakFile::open( const Key & key )
+{
+    close();
+
+    QString filename = location(key);
+    if (filename.isEmpty())
+        return false;
+
+    _file.setFileName(filename);
+    if (!_file.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray path = key.path.toUtf8();
+    PeakFileHeader header;
+
+    bool ok = _file.read((char*) &header, sizeof(header)) == sizeof(header)
+            && memcmp(header.magic, peakFileMagic, sizeof(peakFileMagic)) == 0
+            && header.version == peakFileVersion
+            && header.byteOrder == byteOrderMark
+            && header.fileSize == key.fileSize
+            && header.modified == key.modified
+            && header.beginning == key.beginning
+            && header.duration == key.duration
+            && header.channels == key.channels
+            && header.fpu == key.fpu
+            && header.precision == key.precision
+            && header.dataSize == key.dataSize
+            && header.pathSize == path.size()
+            && header.dataOffset == dataOffset(path.size())
+            && _file.read(header.pathSize) == path
+            && _file.size() == header.dataOffset + header.dataSize;
+
+    if (ok) {
+        // Private, so that the stream may still write to its data.
+        _data = (char*) _file.map(header.dataOffset, header.dataSize,
+                                  QFileDevice::MapPrivateOption);
+        if (!_data || checksum(_data, header.dataSize) != header.checksum) {
+            qWarning() << "SoundPeakFile: Removing damaged peak file:" << filename;
+            close();
+            QFile::remove(filename);
+            return false;
+        }
+    }
+    else {
+        close();
+    }
+
+    return ok;
+}
+
+void SoundPeakFile::close()
+{
+    if (_data)
+        _file.unmap((uchar*) _data);
+    _data = 0;
+    _file.close();
+}
+
+bool SoundPeakFile::write( const Key & key, const char *data )
+{
+    QString filename = location(key);
+    if (filename.isEmpty())
+        return false;
+
+    if (!QDir().mkpath(QFileInfo(filename).path())) {
+        qWarning() << "SoundPeakFile: Could not create directory for:" << filename;
+        return false;
+    }
+
+    QByteArray path = key.path.toUtf8();
+
+    PeakFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, peakFileMagic, sizeof(peakFileMagic));
+    header.version = peakFileVersion;
+    header.byteOrder = byteOrderMark;
+    header.fileSize = key.fileSize;
+    header.modified = key.modified;
+    header.beginning = key.beginning;
+    header.duration = key.duration;
+    header.channels = key.channels;
+    header.fpu = key.fpu;
+    header.dataOffset = dataOffset(path.size());
+    header.dataSize = key.dataSize;
+    header.checksum = checksum(data, key.dataSize);
+    header.pathSize = path.size();
+    header.precision = key.precision;
+
+    QByteArray padding(header.dataOffset - sizeof(header) - path.size(), 0);
+
+    // Replaces any previous file only when complete.
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "SoundPeakFile: Could not write:" << filename;
+        return false;
+    }
+
+    file.write((const char*) &header, sizeof(header));
+    file.write(path);
+    file.write(padding);
+    file.write(data, key.dataSize);
+
+    if (!file.commit()) {
+        qWarning() << "SoundPeakFile: Could not write:" << filename;
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace QuickCollider
@@ -0,0 +1,79 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SOUND_PEAK_FILE_INCLUDED
+#define QUICK_COLLIDER_SOUND_PEAK_FILE_INCLUDED
+
+#include <QString>
+#include <QFile>
+
+#include <sndfile.h>
+
+namespace QuickCollider {
+
+// Integrated data of a SoundCacheStream, persisted in the user's cache
+// directory so that a sound file seen before does not have to be scanned again.
+//
+// A peak file is keyed by the sound file's absolute path, size and modification
+// time, and the cached range, resolution and precision. It holds a versioned header, the
+// sound file path, and the stream's storage verbatim, guarded by a checksum.
+// Files of sound files that have since changed are simply never matched again.
+
+class SoundPeakFile
+{
+public:
+    struct Key {
+        Key(): fileSize(0), modified(0), beginning(0), duration(0),
+            channels(0), fpu(0), precision(0), dataSize(0) {}
+        // Identifies the sound file at 'path' as it is now. Returns false if
+        // there is no such file.
+        bool setSource( const QString & path );
+        QString path; // absolute
+        qint64 fileSize;
+        qint64 modified; // msecs since epoch
+        sf_count_t beginning;
+        sf_count_t duration;
+        int channels;
+        int fpu;
+        int precision; // a SoundCachePrecision
+        qint64 dataSize; // bytes of stream storage
+    };
+
+    SoundPeakFile() : _data(0) {}
+    ~SoundPeakFile() { close(); }
+
+    // Maps the peak file matching 'key' and verifies it. Returns false if there
+    // is none, or it is outdated or damaged.
+    bool open( const Key & key );
+    void close();
+
+    // Copy-on-write mapping of the stored data; valid while open.
+    char *data() const { return _data; }
+
+    // Stores 'data' of key.dataSize bytes. Returns false on failure.
+    static bool write( const Key & key, const char *data );
+
+private:
+    static QString location( const Key & key );
+
+    QFile _file;
+    char *_data;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SOUND_PEAK_FILE_INCLUDED
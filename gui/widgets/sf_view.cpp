@@ -20,10 +20,11 @@
 #define QT_NO_DEBUG_OUTPUT
 
 #include "sf_view.hpp"
+#include "sf_waveform_node.hpp"
 
-#include <QPainter>
 //#include <QCursor>
 
+#include <algorithm>
 #include <climits>
 #include <cmath>
 #include <cstring>
@@ -32,11 +33,19 @@
 
 namespace QuickCollider {
 
-const int kMaxRawFrames = 300000;
+// Samples over all channels read around the view when zoomed in beyond cache level 0
+const int kMaxRawSamples = 600000;
+// Units of cache level 0 over all channels; higher levels add about as much.
+const int kMaxCacheUnits = 1 << 23;
+// Takes precedence over kMaxCacheUnits, so that the frames of a view zoomed in
+// beyond cache level 0 stay few enough to read.
 const int kMaxFramesPerCacheUnit = 128;
+// Display columns per tile, and bytes of tiles kept for scrolling.
+const int kTileColumns = 256;
+const int kMaxTileBytes = 16 << 20;
 
 SoundFileView::SoundFileView( QQuickItem * parent ):
-    QQuickPaintedItem(parent),
+    QQuickItem(parent),
 
     sf(0),
 
@@ -45,6 +54,7 @@ SoundFileView::SoundFileView( QQuickItem * parent ):
     _rangeEnd(0),
 
     _cache(0),
+    _cachePrecision(Precision16),
 
     _curSel(0),
 
@@ -70,6 +80,10 @@ SoundFileView::SoundFileView( QQuickItem * parent ):
 {
     memset( &sfInfo, 0, sizeof(SF_INFO) );
 
+    setFlag( QQuickItem::ItemHasContents, true );
+
+    _tiles.setMaxCost( kMaxTileBytes );
+
     //setFocusPolicy( Qt::StrongFocus );
     //setSizePolicy( QSizePolicy::Expanding, QSizePolicy::Expanding );
     //setAttribute( Qt::WA_OpaquePaintEvent, true );
@@ -95,7 +109,7 @@ void SoundFileView::load( const QString& filename )
         return;
     }
 
-    doLoad( new_sf, new_info, 0, new_info.frames );
+    doLoad( new_sf, new_info, filename, 0, new_info.frames );
 }
 
 void SoundFileView::load( const QString& filename, int beg, int dur )
@@ -112,7 +126,7 @@ void SoundFileView::load( const QString& filename, int beg, int dur )
         return;
     }
 
-    doLoad( new_sf, new_info, beg, dur );
+    doLoad( new_sf, new_info, filename, beg, dur );
 }
 
 void SoundFileView::load( const QVector<double> & data, int offset, int ch, int sr )
@@ -137,7 +151,7 @@ void SoundFileView::load( const QVector<double> & data, int offset, int ch, int
         return;
     }
 
-    delete _cache;
+    resetCache();
     if( sf ) sf_close( sf );
     sf = 0;
 
@@ -152,10 +166,6 @@ void SoundFileView::load( const QVector<double> & data, int offset, int ch, int
 
     updateFPP();
 
-    _cache = new SoundCacheStream();
-    connect( _cache, SIGNAL(loadingDone()), this, SIGNAL(loadingDone()) );
-    connect( _cache, SIGNAL(loadingDone()), this, SLOT(update()) );
-
     _cache->load( data, _rangeDur, offset, ch );
 
     emit visibleRangeChanged();
@@ -168,7 +178,7 @@ void SoundFileView::allocate ( int frames, int ch, int sr )
         return;
     }
 
-    delete _cache;
+    resetCache();
     if( sf ) sf_close( sf );
     sf = 0;
 
@@ -183,7 +193,6 @@ void SoundFileView::allocate ( int frames, int ch, int sr )
 
     updateFPP();
 
-    _cache = new SoundCacheStream();
     _cache->allocate( frames, ch );
 
     update();
@@ -218,16 +227,14 @@ void SoundFileView::write( const QVector<double> & data, int offset )
     }
 
     _cache->write( data, offset, nf );
+    _tiles.clear();
 
     update();
 }
 
-void SoundFileView::doLoad( SNDFILE *new_sf, const SF_INFO &new_info, sf_count_t beg, sf_count_t dur )
+void SoundFileView::doLoad( SNDFILE *new_sf, const SF_INFO &new_info, const QString & filename,
+                            sf_count_t beg, sf_count_t dur )
 {
-    // set up soundfile to scale data in range [-1,1] to int range
-    // when reading floating point data as int
-    sf_command( new_sf, SFC_SET_SCALE_FLOAT_INT_READ, NULL, SF_TRUE );
-
     // check beginning and duration validity
 
     if( beg < 0 || dur < 1 || beg + dur > new_info.frames ) {
@@ -238,11 +245,11 @@ void SoundFileView::doLoad( SNDFILE *new_sf, const SF_INFO &new_info, sf_count_t
 
     // cleanup previous state
 
-    // NOTE we have to delete SoundCacheStream before closing the soundfile, as it might be still
+    // NOTE we have to reset SoundCacheStream before closing the soundfile, as it might be still
     // loading it
     // TODO: should SoundCacheStream open the soundfile on its own?
 
-    delete _cache;
+    resetCache();
     if( sf ) sf_close( sf );
 
     sf = new_sf;
@@ -253,19 +260,109 @@ void SoundFileView::doLoad( SNDFILE *new_sf, const SF_INFO &new_info, sf_count_t
 
     updateFPP();
 
+    _cache->load( sf, sfInfo, filename, beg, dur, kMaxCacheUnits, kMaxFramesPerCacheUnit,
+                  kMaxRawSamples );
+
+    update();
+
+    emit visibleRangeChanged();
+}
+
+void SoundFileView::resetCache()
+{
+    _tiles.clear();
+
+    // Reusing the cache keeps its loader threads for the next load.
+    if( _cache ) {
+        _cache->reset();
+        _cache->setPrecision( (SoundCachePrecision) _cachePrecision );
+        return;
+    }
+
     _cache = new SoundCacheStream();
+    _cache->setPrecision( (SoundCachePrecision) _cachePrecision );
     connect( _cache, SIGNAL(loadProgress(int)),
              this, SIGNAL(loadProgress(int)) );
     connect( _cache, SIGNAL(loadProgress(int)),
              this, SLOT(update()) );
     connect( _cache, SIGNAL(loadingDone()), this, SIGNAL(loadingDone()) );
     connect( _cache, SIGNAL(loadingDone()), this, SLOT(update()) );
+    connect( _cache, SIGNAL(rawWindowReady()), this, SLOT(update()) );
+    connect( _cache, SIGNAL(overviewReady()), this, SLOT(update()) );
+}
+
+const SoundTile *SoundFileView::tile( double fpp, qint64 index )
+{
+    SoundTileKey key = { fpp, index };
+    SoundTile *tile = _tiles.object( key );
+    if( tile )
+        return tile;
+
+    // Beyond the first tile, one more column is computed before it and dropped,
+    // so that extremes join those of the previous tile, as from column to column.
+    int lead = index > 0 ? 1 : 0;
+
+    // Whole columns, and a last partial one at the end of the range
+    double f_beg = _rangeBeg + (double) index * kTileColumns * fpp;
+    double f_lead = f_beg - lead * fpp;
+    double f_rest = _rangeEnd - f_beg;
+    int fullColumns = std::min( (double) kTileColumns, std::floor( f_rest / fpp ) );
+    if( fullColumns > 0 && f_lead + (fullColumns + lead) * fpp > _rangeEnd )
+        --fullColumns;
+    double f_partial = fullColumns < kTileColumns ? f_rest - fullColumns * fpp : 0.0;
+
+    int channels = _cache->channels();
+    tile = new SoundTile;
+    tile->columns = fullColumns + (f_partial > 0.0 ? 1 : 0);
+    tile->data.resize( channels * 4 * kTileColumns );
+    std::vector<float> columns( 4 * (fullColumns + lead) );
+
+    for( int ch = 0; ch < channels; ++ch ) {
+        float *min = &tile->data[ch * 4 * kTileColumns];
+        float *max = min + kTileColumns;
+        float *minRMS = max + kTileColumns;
+        float *maxRMS = minRMS + kTileColumns;
+        int i = fullColumns;
+        if( i > 0 ) {
+            int n = i + lead;
+            float *c = columns.data();
+            _cache->displayData( ch, f_lead, n * fpp, c, c + n, c + 2 * n, c + 3 * n, n );
+            for( int array = 0; array < 4; ++array )
+                std::copy( c + array * n + lead, c + (array + 1) * n, min + array * kTileColumns );
+        }
+        if( f_partial > 0.0 )
+            _cache->displayData( ch, f_beg + i * fpp, f_partial,
+                                 min + i, max + i, minRMS + i, maxRMS + i, 1 );
+    }
 
-    _cache->load( sf, sfInfo, beg, dur, kMaxFramesPerCacheUnit, kMaxRawFrames );
+    _tiles.insert( key, tile, tile->data.size() * sizeof(float) );
+    return tile;
+}
 
-    update();
+int SoundFileView::gatherColumns( qint64 first, int count )
+{
+    int channels = _cache->channels();
+    _columns.resize( channels * 4 * count );
 
-    emit visibleRangeChanged();
+    int gathered = 0;
+    while( gathered < count ) {
+        qint64 column = first + gathered;
+        qint64 index = column / kTileColumns;
+        int offset = column - index * kTileColumns;
+
+        const SoundTile *t = tile( _fpp, index );
+        int n = std::min( count - gathered, t->columns - offset );
+        if( n < 1 )
+            break;
+
+        for( int array = 0; array < channels * 4; ++array ) {
+            const float *src = &t->data[array * kTileColumns + offset];
+            std::copy( src, src + n, &_columns[array * count + gathered] );
+        }
+        gathered += n;
+    }
+
+    return gathered;
 }
 
 float SoundFileView::loadProgress()
@@ -696,32 +793,42 @@ void SoundFileView::rebuildCache ( int maxFPU, int maxRawFrames )
 
 void SoundFileView::geometryChanged (const QRectF & old_geom, const QRectF & new_geom)
 {
+    QQuickItem::geometryChanged( old_geom, new_geom );
     updateFPP();
     update();
 }
 
-void SoundFileView::paint( QPainter * painter )
+QSGNode *SoundFileView::updatePaintNode( QSGNode *oldNode, UpdatePaintNodeData * )
 {
     // FIXME anomaly: when _fpp reaching 1.0 rms can go outside min-max!
 
-    if( _cache && _cache->loading() ) {
-        // TODO: draw loading progress
-        return;
-    }
+    // Geometry is rebuilt here, on the render thread, while this item is not
+    // changing; the GUI thread only schedules updates.
 
-    QRectF contentsRect = contentsBoundingRect();
+    SoundFileViewNode *node = static_cast<SoundFileViewNode*>( oldNode );
+    if( !node )
+        node = new SoundFileViewNode;
+
+    QRectF contentsRect = boundingRect();
     int x = contentsRect.x();
     int width = contentsRect.width();
     int height = contentsRect.height();
     double f_beg = _beg;
     double f_dur = _dur;
 
-    QPainter &p = *painter;
-
-    if( !_cache || !_cache->ready() ) return;
+    // while loading, draw what is loaded so far, and the progress
+    if( _cache && _cache->loading() )
+        node->setProgress( QRectF( x, height - 2, width * _cache->loadProgress() / 100.0, 2 ),
+                           _rmsColor );
+    else
+        node->setProgress( QRectF(), _rmsColor );
 
     // check for sane situation:
-    if( f_beg < _rangeBeg || f_beg + f_dur > _rangeEnd ) return;
+    if( !_cache || !_cache->displayable() || width < 1 ||
+        f_beg < _rangeBeg || f_beg + f_dur > _rangeEnd ) {
+        node->setChannelCount( 0 );
+        return node;
+    }
 
     // data indexes
     sf_count_t i_beg = std::floor(f_beg); // data beginning;
@@ -735,142 +842,93 @@ void SoundFileView::paint( QPainter * painter )
         haveOneMore = false;
     }
 
-    // data source - choose according to horiz. zoom (data-display resolution)
-    bool canUseCache = _fpp < 1.0 ? _cache->fpu() == 1.0 : _fpp >= _cache->fpu();
-
-    SoundStream *soundStream;
-    SoundFileStream sfStream;
-
-    if( canUseCache ) {
-        qDebug("using cache");
-        soundStream = _cache;
-    }
-    else if( sf ) {
-        qDebug("using file");
-        soundStream = &sfStream;
-        sfStream.load( sf, sfInfo, i_beg, i_count );
-    }
-    else {
-        qWarning( "QSoundFileView: can't paint waveform: view resolution exceeds data cache resolution,"
-                      " and soundfile is not given." );
-        return;
+    // data source - the cache has all resolutions down to its level 0; beyond that,
+    // use a window of raw frames once read, or stretch level 0 meanwhile.
+    // Painting never reads the file.
+    SoundStream *soundStream = _cache;
+    if( _cache->fpu() > 1.0 && _fpp < _cache->fpu() ) {
+        SoundStream *rawStream = _cache->rawWindow( i_beg, i_count );
+        if( rawStream )
+            soundStream = rawStream;
     }
 
     // geometry
-    //float spacing = height * 0.15f / (sfInfo.channels + 1);
     int channels = sfInfo.channels;
     float spacing = m_spacing;
     float chHeight = std::max(0.f, (height - (channels - 1) * spacing)) / (float) sfInfo.channels;
     float yScale = -chHeight / 65535.f * _yZoom;
-    //spacing /= yscale;
 
-    // initial painter setup
-    QPen minMaxPen;
-    QPen rmsPen;
+    // While the cache is complete and in use, columns come from tiles on a grid
+    // fixed to the range, so that scrolling only computes newly exposed ones.
+    bool tiled = soundStream == _cache && _cache->ready() && _fpp > 1.0 && _fpp >= _cache->fpu();
+    int tiledStride = 0;
+    int tiledColumns = 0;
+    float tiledX = 0.f;
+    if( tiled ) {
+        double firstColumn = std::floor( (f_beg - _rangeBeg) / _fpp );
+        tiledStride = std::ceil( (f_beg + f_dur - _rangeBeg) / _fpp ) - firstColumn;
+        tiledColumns = gatherColumns( firstColumn, tiledStride );
+        tiledX = x + firstColumn - (f_beg - _rangeBeg) / _fpp;
+    }
 
-    float halfChH = chHeight * 0.5;
-    p.translate( 0.f, halfChH );
+    node->setChannelCount( soundStream->channels() );
 
     int waveColorN = _waveColors.count();
     int ch;
     for( ch = 0; ch < soundStream->channels(); ++ch ) {
+        SoundChannelNode *chNode = node->channel( ch );
+
+        chNode->setRect( QRectF( x, ch * (chHeight + spacing), width, chHeight ) );
 
         if( ch < waveColorN && _waveColors[ch].isValid() ) {
             QColor clr( _waveColors[ch] );
-            rmsPen.setColor( clr );
-            minMaxPen.setColor( clr.darker( 140 ) );
+            chNode->setColors( clr.darker( 140 ), clr );
         }
         else {
-            rmsPen.setColor( _rmsColor );
-            minMaxPen.setColor( _peakColor );
+            chNode->setColors( _peakColor, _rmsColor );
         }
 
-        // draw center line
-        p.setPen( QColor(90,90,90) );
-        p.drawLine( x, 0, x + width, 0 );
+        bool interleaved = false;
+        const float *rawData = 0;
+        if( _fpp <= 1.0 )
+            rawData = soundStream->rawFrames( ch, i_beg, i_count, &interleaved );
 
-        // draw bounding lines
-        /* TODO: optional?
-        p.setPen( QColor(100,100,100) );
-        p.drawLine( x, halfChH, x+width, halfChH );
-        p.drawLine( x, -halfChH, x+width, -halfChH );
-        */
-
-        p.save();
-
-        p.setClipping(true);
-        p.setClipRect( x, -halfChH, x+width, chHeight );
-        p.scale( 1.f, yScale );
-
-        if( _fpp > 1.0 ) {
+        if( !rawData && tiled ) {
+            const float *columns = &_columns[ch * 4 * tiledStride];
+            chNode->setRegions( columns, columns + tiledStride,
+                                columns + 2 * tiledStride, columns + 3 * tiledStride,
+                                tiledColumns, tiledX, yScale );
+        }
+        else if( !rawData ) {
 
-            // draw min-max regions and RMS
+            // min-max regions and RMS
 
-            short minBuffer[width];
-            short maxBuffer[width];
-            short minRMS[width];
-            short maxRMS[width];
+            float minBuffer[width];
+            float maxBuffer[width];
+            float minRMS[width];
+            float maxRMS[width];
 
             bool ok = soundStream->displayData( ch, f_beg, f_dur,
                                                 minBuffer, maxBuffer,
                                                 minRMS, maxRMS,
                                                 width );
-            //    printf("integration ok: %i\n", ok);
             Q_ASSERT( ok );
 
-            int i;
-            for( i = 0; i < width; ++i ) {
-                short min = minBuffer[i];
-                short max = maxBuffer[i];
-                if( max != min ) {
-                    p.setPen( minMaxPen );
-                    p.drawLine( x + i, min, x + i, max );
-                }
-                else {
-                    p.setPen( minMaxPen );
-                    p.drawPoint( x + i, min );
-                }
-                p.setPen( rmsPen );
-                p.drawLine( x + i, minRMS[i], x + i, maxRMS[i] );
-            }
+            chNode->setRegions( minBuffer, maxBuffer, minRMS, maxRMS, width, x, yScale );
         }
         else {
 
-            // draw lines between actual values
+            // lines between actual values
 
             qreal ppf = 1.0 / _fpp;
             qreal dx = (i_beg - f_beg) * ppf;
-
-            bool interleaved = false;
-            short *data = soundStream->rawFrames( ch, i_beg, i_count, &interleaved );
-            //printf("got raw frames ok: %i\n", data != 0 );
-            Q_ASSERT( data != 0 );
             int step = interleaved ? soundStream->channels() : 1;
 
-            QPainterPath path;
-
-            if( i_count ) {
-                QPointF pt( dx, (qreal) *data );
-                path.moveTo( pt );
-            }
-            int f; // frame
-            for( f = 1; f < i_count; ++f ) {
-                data += step;
-                QPointF pt( f * ppf + dx, (qreal) *data );
-                path.lineTo( pt );
-            }
-            if( i_count && !haveOneMore ) {
-                path.lineTo( QPointF( f * ppf + dx, (qreal)*data ) );
-            }
-
-            p.setPen( rmsPen );
-            p.drawPath( path );
+            chNode->setLine( rawData, step, i_count, x + dx, ppf, !haveOneMore, yScale );
         }
-
-        p.restore();
-
-        p.translate( 0.f, chHeight + spacing );
     }
+
+    return node;
 }
 
 } // namespace QuickCollider
@@ -20,8 +20,18 @@
 #ifndef QUICK_COLLIDER_SOUND_FILE_VIEW_INCLUDED
 #define QUICK_COLLIDER_SOUND_FILE_VIEW_INCLUDED
 
-#include <QQuickPaintedItem>
+#include <QQuickItem>
 #include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QCache>
+
+#include "sf_file_mapping.hpp"
+#include "sf_peak_file.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <vector>
 
 #include <sndfile.h>
 
@@ -30,24 +40,73 @@ namespace QuickCollider {
 class SoundFileView;
 class SoundCacheStream;
 
+// Precision of the minima and maxima stored by a SoundCacheStream, trading
+// memory for fidelity; see SoundCacheSample. Sums are always floats.
+enum SoundCachePrecision {
+    CachePrecision8, // log-companded
+    CachePrecision16,
+    CachePrecisionFloat // integrated from float samples, keeping bits below 16
+};
+
+// Integrated data of one channel at one level of a SoundCacheStream.
+// Points into storage owned by the stream. Minima and maxima are of the
+// type for the stream's precision.
 struct SoundCache {
     SoundCache() : min(0), max(0), sum(0), sum2(0) {};
-    ~SoundCache() {
-        delete [] min;
-        delete [] max;
-        delete [] sum;
-        delete [] sum2;
-    }
-    short *min;
-    short *max;
+    template <typename T> T *minimum() const { return static_cast<T*>( min ); }
+    template <typename T> T *maximum() const { return static_cast<T*>( max ); }
+    void *min;
+    void *max;
     float *sum;
     float *sum2;
 };
 
-class SoundFileView : public QQuickPaintedItem
+// Extremes, sum and sum of squares of sound data in the 16-bit range, as
+// accumulated for a display column or a cache unit.
+struct SoundColumnSums {
+    void add( float lo, float hi, double s, double s2 )
+    {
+        if( lo < min ) min = lo;
+        if( hi > max ) max = hi;
+        sum += s;
+        sum_of_squares += s2;
+    }
+    float min;
+    float max;
+    double sum;
+    double sum_of_squares;
+};
+
+// Display columns of all channels, over a fixed span of the sound at one
+// zoom level. For each channel, holds kTileColumns of minima, maxima,
+// RMS minima and RMS maxima, of which 'columns' are valid.
+struct SoundTile {
+    int columns;
+    std::vector<float> data;
+};
+
+struct SoundTileKey {
+    double fpp; // frames per column
+    qint64 index; // tile index from the beginning of the range
+    bool operator == ( const SoundTileKey & other ) const
+    {
+        return fpp == other.fpp && index == other.index;
+    }
+};
+
+inline uint qHash( const SoundTileKey & key )
+{
+    quint64 fppBits;
+    memcpy( &fppBits, &key.fpp, sizeof(fppBits) );
+    return ::qHash( fppBits ) ^ ::qHash( key.index );
+}
+
+class SoundFileView : public QQuickItem
 {
     Q_OBJECT
 
+    Q_ENUMS( CachePrecision )
+
     Q_PROPERTY( float readProgress READ loadProgress )
 
     Q_PROPERTY( int firstFrame READ firstFrame )
@@ -78,9 +137,17 @@ class SoundFileView : public QQuickPaintedItem
     Q_PROPERTY( QColor rmsColor READ rmsColor WRITE setRmsColor )
     Q_PROPERTY( QColor cursorColor READ cursorColor WRITE setCursorColor )
     Q_PROPERTY( QColor gridColor READ gridColor WRITE setGridColor )
+    Q_PROPERTY( CachePrecision cachePrecision READ cachePrecision WRITE setCachePrecision )
 
 public:
 
+    // Precision of the peaks kept in memory; see SoundCachePrecision.
+    enum CachePrecision {
+        Precision8 = CachePrecision8,
+        Precision16 = CachePrecision16,
+        PrecisionFloat = CachePrecisionFloat
+    };
+
     Q_INVOKABLE void load( const QString& filename );
 
     // NOTE: Using int instead of sf_count_t for accessibility from SC language.
@@ -95,7 +162,7 @@ public:
 
     Q_INVOKABLE qreal frameAt( qreal position )
     {
-        QRectF rect = contentsBoundingRect();
+        QRectF rect = boundingRect();
         qreal relativePosition = rect.width() ? position / rect.width() : 0.0;
         return (relativePosition * _dur + _beg);
     }
@@ -174,6 +241,10 @@ public:
     float gridResolution() const { return _gridResolution; }
     void setGridResolution( float f ) { _gridResolution = f; update(); }
 
+    // Takes effect with the next load or allocation.
+    CachePrecision cachePrecision() const { return _cachePrecision; }
+    void setCachePrecision( CachePrecision precision ) { _cachePrecision = precision; }
+
     bool drawsWaveform() const { return _drawWaveform; }
     void setDrawsWaveform( bool b ) { _drawWaveform = b; update(); }
     QVariantList waveColors() const;
@@ -214,14 +285,24 @@ protected:
     virtual void mouseMoveEvent( QMouseEvent * );
 #endif
     virtual void geometryChanged (const QRectF & old_geom, const QRectF & new_geom);
-    virtual void paint(QPainter *);
+    virtual QSGNode *updatePaintNode( QSGNode *oldNode, UpdatePaintNodeData * );
 
 private:
 
-    void doLoad( SNDFILE *new_sf, const SF_INFO &new_info, sf_count_t beginning, sf_count_t duration );
+    void doLoad( SNDFILE *new_sf, const SF_INFO &new_info, const QString & filename,
+                 sf_count_t beginning, sf_count_t duration );
+    // Makes sure there is a cache, not loading nor holding any data.
+    void resetCache();
+    // Returns the tile, computing it from the cache if not in _tiles.
+    // Following calls may evict it.
+    const SoundTile *tile( double fpp, qint64 index );
+    // Copies 'count' columns at the current zoom level into _columns, per
+    // channel 4 arrays of 'count' each as in SoundTile. Returns the number of
+    // columns available, which is less at the end of the range.
+    int gatherColumns( qint64 first, int count );
     void updateFPP()
     {
-        qreal width = contentsBoundingRect().width();
+        qreal width = boundingRect().width();
         _fpp = width > 0.0 ? (double) _dur / width : 0.0;
     }
     void rebuildCache ( int maxFramesPerCache, int maxRawFrames );
@@ -235,6 +316,7 @@ private:
     sf_count_t _rangeEnd;
 
     SoundCacheStream *_cache;
+    CachePrecision _cachePrecision;
 
     // selections
     Selection _selections[64];
@@ -265,6 +347,10 @@ private:
     bool dirty;
     bool _drawWaveform;
     QList<QColor> _waveColors;
+    // Display columns of the cache, once ready, by zoom level and tile;
+    // least recently used ones are dropped beyond a memory budget.
+    QCache<SoundTileKey, SoundTile> _tiles;
+    std::vector<float> _columns;
 
     // interaction
     enum DragAction {
@@ -289,14 +375,15 @@ public:
 
     inline sf_count_t duration() { return _dur; }
 
+    // Values are in the 16-bit sample range.
     virtual bool displayData( int channel, double offset, double duration,
-                              short *minBuffer,
-                              short *maxBuffer,
-                              short *minRMS,
-                              short *maxRMS,
+                              float *minBuffer,
+                              float *maxBuffer,
+                              float *minRMS,
+                              float *maxRMS,
                               int bufferSize ) = 0;
 
-    virtual short *rawFrames( int channel, sf_count_t beginning, sf_count_t duration, bool *interleaved ) = 0;
+    virtual const float *rawFrames( int channel, sf_count_t beginning, sf_count_t duration, bool *interleaved ) = 0;
 
 protected:
     SoundStream()
@@ -316,31 +403,83 @@ public:
     SoundFileStream();
     SoundFileStream( SNDFILE *sf, const SF_INFO &sf_info, sf_count_t beginning, sf_count_t duration );
     ~SoundFileStream();
-    void load( SNDFILE *sf, const SF_INFO &sf_info, sf_count_t beginning, sf_count_t duration );
+    // With 'floatSamples', samples are kept as floats in the 16-bit range,
+    // including the bits below 16 of integer samples; otherwise as shorts.
+    void load( SNDFILE *sf, const SF_INFO &sf_info, sf_count_t beginning, sf_count_t duration,
+               bool floatSamples = false );
+    // Reads from the mapping without locking; single channel 16-bit data
+    // is used in place, and must outlive the use of this stream.
+    void load( const SoundFileMapping & mapping, sf_count_t beginning, sf_count_t duration,
+               bool floatSamples = false );
     bool integrate( int channel, double offset, double duration,
-                    short *minBuffer,
-                    short *maxBuffer,
+                    float *minBuffer,
+                    float *maxBuffer,
                     float *sumBuffer,
                     float *sum2Buffer,
                     int bufferSize );
     bool displayData( int channel, double offset, double duration,
-                      short *minBuffer,
-                      short *maxBuffer,
-                      short *minRMS,
-                      short *maxRMS,
+                      float *minBuffer,
+                      float *maxBuffer,
+                      float *minRMS,
+                      float *maxRMS,
                       int bufferSize );
-    short *rawFrames( int channel, sf_count_t beginning, sf_count_t duration, bool *interleaved );
+    const float *rawFrames( int channel, sf_count_t beginning, sf_count_t duration, bool *interleaved );
 private:
-    short *_data;
+    void reserve( sf_count_t sampleCount );
+    void reserveFloats( sf_count_t sampleCount );
+    bool covers( int channel, double offset, double duration );
+    // Implementations for each type of samples.
+    template <typename T>
+    void integrateAs( const T *data, double offset, double duration,
+                      float *minBuffer, float *maxBuffer, float *sumBuffer, float *sum2Buffer,
+                      int bufferSize );
+    template <typename T>
+    void displayDataAs( const T *data, double offset, double duration,
+                        float *minBuffer, float *maxBuffer, float *minRMS, float *maxRMS,
+                        int bufferSize );
+
+    short *_data; // planar; _buffer, or mapped; 0 while holding floats
+    float *_floatSamples; // planar; _floatBuffer, or 0 while holding shorts
     sf_count_t _dataSize;
     sf_count_t _dataOffset;
+    // Buffers are kept for following loads of at most as many samples.
+    // The others hold interleaved samples as read.
+    short *_buffer;
+    sf_count_t _capacity;
+    float *_floatBuffer;
+    sf_count_t _floatBufferCapacity;
+    float *_floatData;
+    sf_count_t _floatCapacity;
+    short *_interleavedData;
+    sf_count_t _interleavedCapacity;
+    // Shorts converted for rawFrames().
+    std::vector<float> _rawFrames;
 };
 
 class SoundCacheLoader;
+class SoundRawLoader;
+struct SoundReader;
+
+// Integrated sound data at multiple resolutions: level 0 has fpu() frames
+// per unit, and every following level twice as many, so any zoom level can
+// be drawn from memory at a resolution close to the display's.
+//
+// While loading a sound file, an overview sampled from the file is available
+// first, and refined as loading goes on.
+//
+// When zoomed in beyond level 0, a window of raw frames around the requested
+// range is read from the file in the background.
+//
+// Uncompressed sound files are read through a SoundFileMapping, where
+// supported, rather than through libsndfile.
+//
+// Data integrated from a sound file is stored as a SoundPeakFile, and mapped
+// from there instead of being computed again on later loads.
 
 class SoundCacheStream : public QObject, public SoundStream
 {
     friend class SoundCacheLoader;
+    friend class SoundRawLoader;
 
     Q_OBJECT
 
@@ -348,58 +487,202 @@ public:
     SoundCacheStream();
     ~SoundCacheStream();
     void load( const QVector<double> & data, int frames, int offset, int channels );
-    void load( SNDFILE *sf, const SF_INFO &info, sf_count_t beg, sf_count_t dur,
-               int maxFramesPerUnit, int maxRawFrames );
+    // Level 0 has the smallest power-of-two frames per unit for which it has
+    // at most 'maxUnits' units over all channels, but no more than
+    // 'maxFramesPerUnit', which takes precedence. Raw windows hold the range
+    // asked for, and around it up to 'maxRawSamples' over all channels.
+    // 'path' of the sound file, if not empty, identifies a peak file to use
+    // or create.
+    void load( SNDFILE *sf, const SF_INFO &info, const QString & path,
+               sf_count_t beg, sf_count_t dur,
+               int maxUnits, int maxFramesPerUnit, int maxRawSamples );
     void allocate ( int frames, int channels );
     void write( const QVector<double> & data, int offset, int count );
+    // Stops loading and drops all data, after which the sound file being
+    // loaded may be closed.
+    void reset();
+    // Takes effect with the next load or allocation.
+    void setPrecision( SoundCachePrecision precision ) { _nextPrecision = precision; }
+    SoundCachePrecision precision() const { return _nextPrecision; }
 
     inline double fpu() { return _fpu; }
     inline bool ready() { return _ready; }
+    // Whether displayData() can provide anything, perhaps only an overview.
+    inline bool displayable() { return _ready || _overviewLevel >= 0; }
     inline bool loading() { return _loading; }
     inline int loadProgress() { return _loadProgress; }
+    inline int levels() { return _levelSizes.size(); }
     bool displayData( int channel, double offset, double duration,
-                      short *minBuffer,
-                      short *maxBuffer,
-                      short *minRMS,
-                      short *maxRMS,
+                      float *minBuffer,
+                      float *maxBuffer,
+                      float *minRMS,
+                      float *maxRMS,
                       int bufferSize );
-    short *rawFrames( int channel, sf_count_t beginning, sf_count_t duration, bool *interleaved );
+    const float *rawFrames( int channel, sf_count_t beginning, sf_count_t duration, bool *interleaved );
+
+    // Returns a stream of raw frames covering the range, if already read.
+    // Otherwise, starts reading a window around it and returns 0;
+    // rawWindowReady() is emitted when done.
+    SoundStream *rawWindow( sf_count_t beginning, sf_count_t duration );
 
 Q_SIGNALS:
     void loadProgress( int );
     void loadingDone();
+    void rawWindowReady();
+    void overviewReady();
 
 private Q_SLOTS:
-    void onLoadProgress( int );
-    void onLoadingDone();
+    void onLoadProgress( int generation, int progress );
+    void onLoadingDone( int generation );
+    void onRawWindowLoaded();
+    void onOverviewDone( int generation, int level );
 
 private:
-    SoundCache *_caches;
-    double _fpu; // soundfile frames per cache unit
+    void clear();
+    // Sets the size of levels, and returns the amount of storage they need.
+    size_t layoutLevels( int channels, sf_count_t units );
+    // Points the levels into 'storage', which must have the size returned by layoutLevels().
+    void setStorage( char *storage );
+    SoundCache & cache( int level, int channel ) { return _caches[level * _ch + channel]; }
+    // Recomputes all units of levels [firstLevel, lastLevel] that depend on
+    // level-0 units [begin, end); lastLevel < 0 means the top level.
+    void reduceLevels( sf_count_t begin, sf_count_t end, int firstLevel = 1, int lastLevel = -1 );
+    // Stores 'count' units of extremes at 'unit' of 'cache', in the stream's precision.
+    void storeExtremes( SoundCache & cache, sf_count_t unit,
+                        const float *min, const float *max, int count );
+
+    // Implementations for each type of minima and maxima.
+    template <typename T>
+    void reduceExtremes( const SoundCache & src, SoundCache & dst,
+                         sf_count_t begin, sf_count_t end, sf_count_t srcSize );
+    template <typename T>
+    void storeExtremesAs( SoundCache & cache, sf_count_t unit,
+                          const float *min, const float *max, int count );
+    template <typename T>
+    void storeFrames( const QVector<double> & data, int dataOffset, int begin, int end );
+    template <typename T>
+    bool displayDataAs( int channel, double offset, double duration,
+                        float *minBuffer, float *maxBuffer, float *minRMS, float *maxRMS,
+                        int bufferSize );
+    template <typename T>
+    const float *rawFramesAs( int channel, sf_count_t beginning, sf_count_t duration );
+
+    SoundCachePrecision _precision; // of the current data
+    SoundCachePrecision _nextPrecision;
+    char *_storage; // owned, unless mapped from _peakFile
+    std::vector<SoundCache> _caches; // per level, per channel
+    std::vector<sf_count_t> _levelSizes; // units per level
+    double _fpu; // soundfile frames per cache unit at level 0
     sf_count_t _dataOffset; // offset into soundfile of first frame cached (in frames)
-    sf_count_t _dataSize; // amount of cache units
+    sf_count_t _dataSize; // amount of cache units at level 0
     bool _ready;
     bool _loading;
     SoundCacheLoader *_loader;
     int _loadProgress;
+    // Tells apart the loader's signals about the current data from late ones.
+    int _generation;
+    // While loading, the finest level with complete (if approximate) data, or -1.
+    int _overviewLevel;
+
+    SNDFILE *_sf;
+    SF_INFO _info;
+    QString _path;
+    // Serializes access to _sf by the loaders.
+    QMutex _sfMutex;
+    // Used instead of _sf by the loaders, if open.
+    SoundFileMapping _mapping;
+    int _maxRawSamples;
+    SoundFileStream *_rawWindow;
+    SoundRawLoader *_rawLoader;
+    // Level 0 converted to floats for rawFrames(), unless stored so.
+    std::vector<float> _rawFrames;
+
+    SoundPeakFile::Key _peakKey;
+    SoundPeakFile _peakFile;
 };
 
+class SoundCacheWorker;
+
+// Integrates the sound file into the cache in chunks, distributed among a pool
+// of worker threads that each read through their own handle of the file.
+//
+// Before the full pass, workers fill an overview level by sampling a few frames
+// of every unit, so the whole file can be drawn roughly right away. The full
+// pass then refines the overview as it completes chunks.
+//
+// The loader thread keeps running between loads. Loading is stopped by
+// a flag checked by workers for every chunk.
 class SoundCacheLoader : public QThread
 {
     Q_OBJECT
+    friend class SoundCacheWorker;
 public:
-    SoundCacheLoader( SoundCacheStream *cache ) : QThread( cache ), _cache( cache ), _sf(0) {}
-    void load( SNDFILE *sf, const SF_INFO &info );
+    SoundCacheLoader( SoundCacheStream *cache );
+    ~SoundCacheLoader();
+    // Loads the cache as currently laid out. Signals carry 'generation'.
+    void load( int generation );
+    // Stops loading, if in progress. On return, the cache is not accessed anymore.
+    void stop();
 
 Q_SIGNALS:
-    void loadProgress( int );
-    void loadingDone();
+    void loadProgress( int generation, int progress );
+    void overviewDone( int generation, int level );
+    void loadingDone( int generation );
 private:
     void run();
+    void loadCache( int generation );
+    void runWorkers( sf_count_t tasks );
+    void work( SoundFileStream & buffer );
+    void sampleOverview( SoundReader & reader, SoundFileStream & buffer );
+    void integrateChunks( SoundReader & reader, SoundFileStream & buffer );
 
     SoundCacheStream *_cache;
-    SNDFILE *_sf;
-    SF_INFO _info;
+    std::vector<SoundCacheWorker*> _workers;
+    std::atomic<int> _nextChunk;
+    std::atomic<int> _unitsDone;
+    std::atomic<int> _progress;
+    std::atomic<bool> _cancel;
+    int _generation;
+    int _overviewLevel;
+    int _chunkLevels; // chunks have 2^_chunkLevels units
+    bool _sampling; // whether workers sample the overview, or integrate chunks
+
+    QMutex _mutex;
+    QWaitCondition _requestCondition;
+    QWaitCondition _idleCondition;
+    bool _requested;
+    bool _busy;
+    bool _quit;
+};
+
+// Reads the latest requested window of raw frames.
+class SoundRawLoader : public QThread
+{
+    Q_OBJECT
+public:
+    SoundRawLoader( SoundCacheStream *cache ) :
+        QThread( cache ), _cache( cache ), _pending( false ), _busy( false ), _result( 0 ) {}
+    ~SoundRawLoader() { wait(); delete _result; }
+    void request( sf_count_t beginning, sf_count_t duration );
+    // Whether the range is covered by the pending or running request.
+    bool isRequested( sf_count_t beginning, sf_count_t duration );
+    // Returns the latest loaded window, if any, which the caller takes over.
+    SoundFileStream *take();
+
+Q_SIGNALS:
+    void loaded();
+private:
+    void run();
+
+    SoundCacheStream *_cache;
+    QMutex _mutex;
+    bool _pending;
+    bool _busy;
+    sf_count_t _beg;
+    sf_count_t _dur;
+    sf_count_t _requestedBeg;
+    sf_count_t _requestedDur;
+    SoundFileStream *_result;
 };
 
 } // namespace QuickCollider
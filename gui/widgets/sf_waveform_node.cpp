@@ -0,0 +1,179 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sf_waveform_node.hpp"
+#include "geometry_capacity.hpp"
+
+#include <cmath>
+
+namespace QuickCollider {
+
+SoundWaveNode::SoundWaveNode( GLenum drawingMode ):
+    m_geometry(QSGGeometry::defaultAttributes_Point2D(), 0)
+{
+    m_geometry.setDrawingMode(drawingMode);
+    m_geometry.setLineWidth(1);
+    // Replaced whenever the view scrolls or zooms
+    m_geometry.setVertexDataPattern(QSGGeometry::StreamPattern);
+
+    setGeometry(&m_geometry);
+    setMaterial(&m_material);
+}
+
+void SoundWaveNode::setColor( const QColor & color )
+{
+    if (m_material.color() == color)
+        return;
+    m_material.setColor(color);
+    markDirty(QSGNode::DirtyMaterial);
+}
+
+QSGGeometry::Point2D *SoundWaveNode::vertices( int count )
+{
+    reserveLineStrip(m_geometry, count);
+    return m_geometry.vertexDataAsPoint2D();
+}
+
+void SoundWaveNode::commit( int count )
+{
+    // Collapsed vertices also make empty triangles.
+    padLineStrip(m_geometry, count);
+    markDirty(QSGNode::DirtyGeometry);
+}
+
+SoundChannelNode::SoundChannelNode():
+    m_clipGeometry(QSGGeometry::defaultAttributes_Point2D(), 4),
+    m_center(new SoundWaveNode(GL_LINES)),
+    m_peaks(new SoundWaveNode(GL_TRIANGLE_STRIP)),
+    m_rms(new SoundWaveNode(GL_TRIANGLE_STRIP)),
+    m_line(new SoundWaveNode(GL_LINE_STRIP))
+{
+    setIsRectangular(true);
+    setGeometry(&m_clipGeometry);
+
+    m_center->setColor(QColor(90,90,90));
+
+    appendChildNode(m_center);
+    appendChildNode(m_peaks);
+    appendChildNode(m_rms);
+    appendChildNode(m_line);
+}
+
+void SoundChannelNode::setRect( const QRectF & rect )
+{
+    if (rect == m_rect)
+        return;
+    m_rect = rect;
+
+    setClipRect(rect);
+    QSGGeometry::updateRectGeometry(&m_clipGeometry, rect);
+    markDirty(QSGNode::DirtyGeometry);
+
+    float y = rect.center().y();
+    QSGGeometry::Point2D *vertices = m_center->vertices(2);
+    vertices[0].set(rect.left(), y);
+    vertices[1].set(rect.right(), y);
+    m_center->commit(2);
+}
+
+void SoundChannelNode::setColors( const QColor & peakColor, const QColor & rmsColor )
+{
+    m_peaks->setColor(peakColor);
+    m_rms->setColor(rmsColor);
+    m_line->setColor(rmsColor);
+}
+
+void SoundChannelNode::setRegions( const float *min, const float *max,
+                                   const float *minRMS, const float *maxRMS,
+                                   int columns, float x, float yScale )
+{
+    setStrip(m_peaks, min, max, columns, x, yScale);
+    setStrip(m_rms, minRMS, maxRMS, columns, x, yScale);
+    m_line->commit(0);
+}
+
+void SoundChannelNode::setLine( const float *data, int step, int count,
+                                float x, float dx, bool extend, float yScale )
+{
+    float center = m_rect.center().y();
+    int vertexCount = count > 0 && extend ? count + 1 : count;
+
+    QSGGeometry::Point2D *vertices = m_line->vertices(vertexCount);
+    for (int i = 0; i < count; ++i, data += step)
+        vertices[i].set(x + i * dx, center + *data * yScale);
+    if (vertexCount > count)
+        vertices[count].set(x + count * dx, vertices[count - 1].y);
+    m_line->commit(vertexCount);
+
+    m_peaks->commit(0);
+    m_rms->commit(0);
+}
+
+void SoundChannelNode::setStrip( SoundWaveNode *node, const float *lower, const float *upper,
+                                 int columns, float x, float yScale )
+{
+    x += 0.5f;
+    float center = m_rect.center().y();
+
+    // Columns span at least a pixel, like a line between equal points would.
+    QSGGeometry::Point2D *vertices = node->vertices(columns * 2);
+    for (int i = 0; i < columns; ++i) {
+        float y0 = center + lower[i] * yScale;
+        float y1 = center + upper[i] * yScale;
+        if (std::abs(y1 - y0) < 1.f) {
+            float middle = (y0 + y1) * 0.5f;
+            y0 = middle - 0.5f;
+            y1 = middle + 0.5f;
+        }
+        vertices[i * 2].set(x + i, y0);
+        vertices[i * 2 + 1].set(x + i, y1);
+    }
+    node->commit(columns * 2);
+}
+
+SoundFileViewNode::SoundFileViewNode():
+    m_progress(new QSGSimpleRectNode)
+{
+    appendChildNode(m_progress);
+}
+
+void SoundFileViewNode::setProgress( const QRectF & rect, const QColor & color )
+{
+    if (m_progress->rect() != rect)
+        m_progress->setRect(rect);
+    if (m_progress->color() != color)
+        m_progress->setColor(color);
+}
+
+void SoundFileViewNode::setChannelCount( int count )
+{
+    while ((int) m_channels.size() > count) {
+        SoundChannelNode *node = m_channels.back();
+        m_channels.pop_back();
+        removeChildNode(node);
+        delete node;
+    }
+
+    while ((int) m_channels.size() < count) {
+        SoundChannelNode *node = new SoundChannelNode;
+        m_channels.push_back(node);
+        // Keeps the progress bar drawn over the channels.
+        insertChildNodeBefore(node, m_progress);
+    }
+}
+
+} // namespace QuickCollider
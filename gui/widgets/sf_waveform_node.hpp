@@ -0,0 +1,97 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SOUND_WAVEFORM_NODE_INCLUDED
+#define QUICK_COLLIDER_SOUND_WAVEFORM_NODE_INCLUDED
+
+#include <QSGGeometryNode>
+#include <QSGGeometry>
+#include <QSGClipNode>
+#include <QSGSimpleRectNode>
+#include <QSGFlatColorMaterial>
+#include <QColor>
+#include <QRectF>
+
+#include <vector>
+
+namespace QuickCollider {
+
+// A single-colored geometry whose vertex data is kept between updates.
+class SoundWaveNode : public QSGGeometryNode
+{
+public:
+    SoundWaveNode( GLenum drawingMode );
+    void setColor( const QColor & color );
+    // Returns room for 'count' vertices; call commit() once written.
+    QSGGeometry::Point2D *vertices( int count );
+    void commit( int count );
+
+private:
+    QSGGeometry m_geometry;
+    QSGFlatColorMaterial m_material;
+};
+
+// One channel of a SoundFileView, clipped to its rectangle: a center line,
+// and either the peak and RMS regions of each pixel column as triangle strips,
+// or a line through raw frames.
+//
+// Sample values are placed at the center of the rectangle, scaled by 'yScale'.
+class SoundChannelNode : public QSGClipNode
+{
+public:
+    SoundChannelNode();
+    void setRect( const QRectF & rect );
+    void setColors( const QColor & peakColor, const QColor & rmsColor );
+    // Columns are a pixel wide, the first one beginning at 'x'.
+    void setRegions( const float *min, const float *max,
+                     const float *minRMS, const float *maxRMS,
+                     int columns, float x, float yScale );
+    // Frames are 'step' samples apart in 'data', and 'dx' pixels apart from 'x'.
+    // With 'extend', the line holds the last value for one more frame.
+    void setLine( const float *data, int step, int count,
+                  float x, float dx, bool extend, float yScale );
+
+private:
+    void setStrip( SoundWaveNode *node, const float *lower, const float *upper,
+                   int columns, float x, float yScale );
+
+    QSGGeometry m_clipGeometry;
+    QRectF m_rect;
+    SoundWaveNode *m_center;
+    SoundWaveNode *m_peaks;
+    SoundWaveNode *m_rms;
+    SoundWaveNode *m_line;
+};
+
+// Root node of a SoundFileView: the channels, and the load progress bar over them.
+class SoundFileViewNode : public QSGNode
+{
+public:
+    SoundFileViewNode();
+    // An empty rectangle hides the progress bar.
+    void setProgress( const QRectF & rect, const QColor & color );
+    void setChannelCount( int count );
+    SoundChannelNode *channel( int index ) { return m_channels[index]; }
+
+private:
+    QSGSimpleRectNode *m_progress;
+    std::vector<SoundChannelNode*> m_channels;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SOUND_WAVEFORM_NODE_INCLUDED
@@ -0,0 +1,92 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "shm_client_pool.hpp"
+
+#include <QHash>
+#include <QMutex>
+#include <QDebug>
+
+namespace QuickCollider {
+
+namespace {
+
+struct PooledClient
+{
+    PooledClient(): client(0), users(0) {}
+
+    server_shared_memory_client *client;
+    int users;
+};
+
+QMutex g_pool_mutex;
+
+// by port
+QHash<int, PooledClient> & pool()
+{
+    static QHash<int, PooledClient> clients;
+    return clients;
+}
+
+} // namespace
+
+server_shared_memory_client * ShmClientPool::acquire( int port, const char * user )
+{
+    QMutexLocker locker(&g_pool_mutex);
+
+    PooledClient & entry = pool()[port];
+
+    if (!entry.client)
+    {
+        try {
+            entry.client = new server_shared_memory_client(port);
+            qDebug("%s: Shared memory connected", user);
+        } catch (std::exception & e) {
+            pool().remove(port);
+            qWarning() << user << ": Cannot connect to shared memory:" << e.what();
+            return 0;
+        }
+    }
+
+    ++entry.users;
+    return entry.client;
+}
+
+void ShmClientPool::release( server_shared_memory_client * client )
+{
+    if (!client)
+        return;
+
+    QMutexLocker locker(&g_pool_mutex);
+
+    QHash<int, PooledClient>::iterator it;
+    for (it = pool().begin(); it != pool().end(); ++it)
+    {
+        if (it->client != client)
+            continue;
+
+        if (--it->users == 0) {
+            delete it->client;
+            pool().erase(it);
+        }
+        return;
+    }
+
+    qWarning("ShmClientPool: Releasing unknown client!");
+}
+
+} // namespace QuickCollider
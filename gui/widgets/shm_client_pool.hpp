@@ -0,0 +1,49 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SHM_CLIENT_POOL_INCLUDED
+#define QUICK_COLLIDER_SHM_CLIENT_POOL_INCLUDED
+
+// from SC source:
+#include <common/server_shm.hpp>
+
+namespace QuickCollider {
+
+// Process-wide, reference-counted shared memory clients, one per server port,
+// so that any amount of scopes and meters share a single mapping.
+
+class ShmClientPool
+{
+public:
+    // Amount of control buses assumed unless told otherwise: the default
+    // numControlBusChannels of older scsynth versions, which newer ones
+    // exceed. The shared memory interface does not tell the actual amount,
+    // and buses beyond it are outside the shared memory.
+    enum { DefaultControlBusCount = 4096 };
+
+    // Returns the client for the server at 'port', connecting if there is none yet,
+    // or 0 if connecting fails. Every client returned must be released.
+    // 'user' names the caller in warnings.
+    static server_shared_memory_client * acquire( int port, const char * user );
+
+    // Disconnects when the last user of a client releases it.
+    static void release( server_shared_memory_client * client );
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SHM_CLIENT_POOL_INCLUDED
@@ -0,0 +1,476 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "spectrogram.hpp"
+#include "oscilloscope_shm.hpp"
+#include "shm_client_pool.hpp"
+
+#include <QSGGeometryNode>
+#include <QSGMaterialShader>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QDebug>
+
+#include <algorithm>
+
+#ifndef GL_RED
+#define GL_RED 0x1903
+#endif
+#ifndef GL_R8
+#define GL_R8 0x8229
+#endif
+
+namespace QuickCollider {
+
+namespace {
+
+class SpectrogramMaterial : public QSGMaterial
+{
+public:
+    SpectrogramMaterial(): texture(0), offset(0.f), scale(1.f) {}
+
+    QSGMaterialType *type() const
+    {
+        static QSGMaterialType type;
+        return &type;
+    }
+
+    QSGMaterialShader *createShader() const;
+
+    int compare( const QSGMaterial * other ) const
+    {
+        const SpectrogramMaterial *m = static_cast<const SpectrogramMaterial*>(other);
+        if (m == this)
+            return 0;
+        return this < m ? -1 : 1;
+    }
+
+    GLuint texture;
+    // Texture row (v) = fract(offset + x * scale), for x from 0 to 1 across the item.
+    float offset;
+    float scale;
+};
+
+class SpectrogramShader : public QSGMaterialShader
+{
+public:
+    const char *vertexShader() const
+    {
+        return
+                "attribute highp vec4 vertex;\n"
+                "attribute highp vec2 texCoord;\n"
+                "uniform highp mat4 qt_Matrix;\n"
+                "varying highp vec2 coord;\n"
+                "void main() {\n"
+                "    coord = texCoord;\n"
+                "    gl_Position = qt_Matrix * vertex;\n"
+                "}\n";
+    }
+
+    const char *fragmentShader() const
+    {
+        return
+                "uniform sampler2D spectrum;\n"
+                "uniform highp float offset;\n"
+                "uniform highp float scale;\n"
+                "uniform lowp float qt_Opacity;\n"
+                "varying highp vec2 coord;\n"
+                // black - blue - purple - orange - pale yellow
+                "lowp vec3 heat(lowp float v) {\n"
+                "    lowp float s = v * 4.0;\n"
+                "    if (s < 1.0) return mix(vec3(0.0, 0.0, 0.0), vec3(0.1, 0.0, 0.5), s);\n"
+                "    if (s < 2.0) return mix(vec3(0.1, 0.0, 0.5), vec3(0.7, 0.0, 0.5), s - 1.0);\n"
+                "    if (s < 3.0) return mix(vec3(0.7, 0.0, 0.5), vec3(1.0, 0.5, 0.0), s - 2.0);\n"
+                "    return mix(vec3(1.0, 0.5, 0.0), vec3(1.0, 1.0, 0.8), min(s - 3.0, 1.0));\n"
+                "}\n"
+                "void main() {\n"
+                // texture columns are frequencies, rows are time
+                "    highp vec2 pos = vec2(1.0 - coord.y, fract(offset + coord.x * scale));\n"
+                "    lowp float v = texture2D(spectrum, pos).r;\n"
+                "    gl_FragColor = vec4(heat(v), 1.0) * qt_Opacity;\n"
+                "}\n";
+    }
+
+    char const *const *attributeNames() const
+    {
+        static char const *const names[] = { "vertex", "texCoord", 0 };
+        return names;
+    }
+
+    void updateState( const RenderState & state, QSGMaterial * newMaterial, QSGMaterial * )
+    {
+        QOpenGLShaderProgram *p = program();
+
+        if (state.isMatrixDirty())
+            p->setUniformValue(m_matrix_id, state.combinedMatrix());
+        if (state.isOpacityDirty())
+            p->setUniformValue(m_opacity_id, state.opacity());
+
+        SpectrogramMaterial *m = static_cast<SpectrogramMaterial*>(newMaterial);
+        p->setUniformValue(m_offset_id, m->offset);
+        p->setUniformValue(m_scale_id, m->scale);
+
+        state.context()->functions()->glBindTexture(GL_TEXTURE_2D, m->texture);
+    }
+
+protected:
+    void initialize()
+    {
+        QOpenGLShaderProgram *p = program();
+        m_matrix_id = p->uniformLocation("qt_Matrix");
+        m_opacity_id = p->uniformLocation("qt_Opacity");
+        m_offset_id = p->uniformLocation("offset");
+        m_scale_id = p->uniformLocation("scale");
+        p->bind();
+        p->setUniformValue("spectrum", 0);
+    }
+
+private:
+    int m_matrix_id;
+    int m_opacity_id;
+    int m_offset_id;
+    int m_scale_id;
+};
+
+QSGMaterialShader *SpectrogramMaterial::createShader() const
+{
+    return new SpectrogramShader;
+}
+
+class SpectrogramNode : public QSGGeometryNode
+{
+public:
+    SpectrogramNode():
+        m_geometry(QSGGeometry::defaultAttributes_TexturedPoint2D(), 4),
+        m_source_bins(0),
+        m_source_history(0),
+        m_bins(0),
+        m_history(0),
+        m_rows(0),
+        m_write(0),
+        m_format(GL_RED)
+    {
+        m_geometry.setDrawingMode(GL_TRIANGLE_STRIP);
+        setGeometry(&m_geometry);
+        setMaterial(&m_material);
+    }
+
+    ~SpectrogramNode()
+    {
+        QOpenGLContext *context = QOpenGLContext::currentContext();
+        if (m_material.texture && context)
+            context->functions()->glDeleteTextures(1, &m_material.texture);
+    }
+
+    void setRect( const QRectF & rect )
+    {
+        QSGGeometry::updateTexturedRectGeometry(&m_geometry, rect, QRectF(0, 0, 1, 1));
+        markDirty(QSGNode::DirtyGeometry);
+    }
+
+    // Recreates the texture (clearing history) if the format changes.
+    void setFormat( int bins, int history );
+
+    // Uploads 'count' columns of 'bins' bytes each, replacing the oldest.
+    void addColumns( const unsigned char * data, int count );
+
+private:
+    void updatePlacement();
+
+    QSGGeometry m_geometry;
+    SpectrogramMaterial m_material;
+    // As requested in setFormat()
+    int m_source_bins;
+    int m_source_history;
+    // Texture columns; at most GL_MAX_TEXTURE_SIZE, so possibly fewer than
+    // 'm_source_bins', in which case columns are decimated before upload.
+    int m_bins;
+    int m_history;
+    // Texture rows; at least 'history', but possibly more.
+    int m_rows;
+    // Next row to write
+    int m_write;
+    GLenum m_format;
+    std::vector<unsigned char> m_decimated;
+};
+
+void SpectrogramNode::setFormat( int bins, int history )
+{
+    if (bins == m_source_bins && history == m_source_history)
+        return;
+
+    m_source_bins = bins;
+    m_source_history = history;
+
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    QOpenGLFunctions *gl = context->functions();
+    QSurfaceFormat surface = context->format();
+
+    GLint max_size = 0;
+    gl->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+    m_bins = qMin(bins, (int) max_size);
+    m_history = qMin(history, (int) max_size);
+    m_rows = m_history;
+
+    // OpenGL ES 2 only repeats power-of-two textures, and lacks GL_RED.
+    bool legacy = context->isOpenGLES() ? surface.majorVersion() < 3
+                                        : surface.profile() != QSurfaceFormat::CoreProfile;
+    if (context->isOpenGLES() && surface.majorVersion() < 3) {
+        m_rows = 1;
+        while (m_rows < m_history)
+            m_rows *= 2;
+        if (m_rows > max_size)
+            m_history = m_rows = m_rows / 2;
+    }
+    m_format = legacy ? GL_LUMINANCE : GL_RED;
+    GLint internal_format = legacy ? GL_LUMINANCE : GL_R8;
+
+    if (!m_material.texture)
+        gl->glGenTextures(1, &m_material.texture);
+
+    gl->glBindTexture(GL_TEXTURE_2D, m_material.texture);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    std::vector<unsigned char> empty(m_bins * m_rows, 0);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    gl->glTexImage2D(GL_TEXTURE_2D, 0, internal_format, m_bins, m_rows, 0,
+                     m_format, GL_UNSIGNED_BYTE, empty.data());
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    m_write = 0;
+    updatePlacement();
+}
+
+void SpectrogramNode::addColumns( const unsigned char * data, int count )
+{
+    if (!m_material.texture || count < 1)
+        return;
+
+    // Older columns would be overwritten right away.
+    if (count > m_history) {
+        data += (count - m_history) * m_source_bins;
+        count = m_history;
+    }
+
+    // Keep the strongest bin of each group, so narrow peaks stay visible.
+    if (m_bins < m_source_bins) {
+        m_decimated.resize( (size_t) count * m_bins );
+        for (int col = 0; col < count; ++col) {
+            const unsigned char *source = data + (size_t) col * m_source_bins;
+            unsigned char *target = m_decimated.data() + (size_t) col * m_bins;
+            for (int bin = 0; bin < m_bins; ++bin) {
+                int begin = (int) ((qint64) bin * m_source_bins / m_bins);
+                int end = (int) ((qint64) (bin + 1) * m_source_bins / m_bins);
+                target[bin] = *std::max_element( source + begin, source + end );
+            }
+        }
+        data = m_decimated.data();
+    }
+
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    gl->glBindTexture(GL_TEXTURE_2D, m_material.texture);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // One upload, or two when wrapping around the end of the texture.
+    int first = qMin(count, m_rows - m_write);
+    gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, m_write, m_bins, first,
+                        m_format, GL_UNSIGNED_BYTE, data);
+    if (count > first)
+        gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_bins, count - first,
+                            m_format, GL_UNSIGNED_BYTE, data + first * m_bins);
+
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    m_write = (m_write + count) % m_rows;
+    updatePlacement();
+}
+
+void SpectrogramNode::updatePlacement()
+{
+    // From the center of the oldest shown row to the center of the newest.
+    int oldest = (m_write - m_history + m_rows) % m_rows;
+    m_material.offset = (oldest + 0.5f) / m_rows;
+    m_material.scale = float(m_history - 1) / m_rows;
+    markDirty(QSGNode::DirtyMaterial);
+}
+
+} // namespace
+
+Spectrogram::Spectrogram( QQuickItem * parent ):
+    QQuickItem(parent),
+    m_server_port(-1),
+    m_scope_index(-1),
+    m_channel(0),
+    m_history(1024),
+    m_running(false),
+    m_shm(new OscilloscopeShm(this)),
+    m_reader(new ScopeReaderThread(m_shm, this))
+{
+    setFlag( QQuickItem::ItemHasContents, true );
+
+    // Every column stands on its own.
+    m_settings.averaging = 0.f;
+    m_reader->setProcessing( ScopeReaderThread::SpectrumColumns );
+    m_reader->setSpectrumSettings( m_settings );
+    m_reader->setMaxColumns( m_history );
+
+    m_timer = new QTimer( this );
+    m_timer->setInterval( 30 );
+    connect( m_timer, SIGNAL( timeout() ), this, SLOT( checkColumns() ) );
+}
+
+Spectrogram::~Spectrogram()
+{
+    stop();
+}
+
+void Spectrogram::setServerPort( int port )
+{
+    if (m_running) {
+        qWarning( "Spectrogram: Can not change server port while running!" );
+        return;
+    }
+
+    m_server_port = port;
+}
+
+void Spectrogram::setBufferNumber( int index )
+{
+    m_scope_index = index;
+
+    if (m_running && !connectReader())
+        stop();
+}
+
+void Spectrogram::setChannel( int channel )
+{
+    m_channel = channel;
+    m_reader->setColumnChannel( channel );
+}
+
+void Spectrogram::setHistory( int columns )
+{
+    m_history = qBound(2, columns, 65536);
+    m_reader->setMaxColumns( m_history );
+    update();
+}
+
+void Spectrogram::setBins( int bins )
+{
+    m_settings.bins = qBound(2, bins, 4096);
+    m_reader->setSpectrumSettings( m_settings );
+    update();
+}
+
+void Spectrogram::setRange( float range )
+{
+    m_settings.range = qMax(1.f, range);
+    m_reader->setSpectrumSettings( m_settings );
+}
+
+void Spectrogram::start()
+{
+    if (m_running) return;
+    if (m_server_port < 0 || m_scope_index < 0) return;
+
+    if (!connectReader())
+        return;
+
+    m_timer->start();
+
+    m_running = true;
+
+    emit runningChanged(m_running);
+}
+
+void Spectrogram::stop()
+{
+    disconnectReader();
+
+    m_timer->stop();
+
+    m_running = false;
+
+    emit runningChanged(m_running);
+
+    update();
+}
+
+bool Spectrogram::connectReader()
+{
+    disconnectReader();
+
+    // Other scopes on the same server share the client.
+    m_shm->client = ShmClientPool::acquire( m_server_port, "Spectrogram" );
+    if (!m_shm->client)
+        return false;
+
+    m_shm->reader = m_shm->client->get_scope_buffer_reader( m_scope_index );
+
+    std::vector<unsigned char> stale;
+    int bins;
+    m_reader->takeColumns( stale, bins );
+
+    m_reader->start();
+    return true;
+}
+
+void Spectrogram::disconnectReader()
+{
+    m_reader->stopReading();
+
+    m_shm->reader = scope_buffer_reader();
+    ShmClientPool::release( m_shm->client );
+    m_shm->client = 0;
+}
+
+void Spectrogram::checkColumns()
+{
+    if (m_reader->hasColumns())
+        update();
+}
+
+QSGNode * Spectrogram::updatePaintNode( QSGNode * oldNode, UpdatePaintNodeData * )
+{
+    if (!m_running) {
+        delete oldNode;
+        return 0;
+    }
+
+    SpectrogramNode *node = static_cast<SpectrogramNode*>(oldNode);
+    if (!node)
+        node = new SpectrogramNode;
+
+    int bins;
+    m_reader->takeColumns( m_columns, bins );
+    // No column yet
+    if (bins < 1)
+        bins = m_settings.bins;
+
+    node->setFormat( bins, m_history );
+    node->addColumns( m_columns.data(), m_columns.size() / bins );
+    node->setRect( boundingRect() );
+
+    return node;
+}
+
+} // namespace QuickCollider
@@ -0,0 +1,121 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SPECTROGRAM_INCLUDED
+#define QUICK_COLLIDER_SPECTROGRAM_INCLUDED
+
+#include "scope_spectrum.hpp"
+
+#include <QQuickItem>
+#include <QTimer>
+
+#include <vector>
+
+namespace QuickCollider
+{
+class OscilloscopeShm;
+class ScopeReaderThread;
+
+// Scrolling time-frequency display of one channel of a server scope buffer.
+//
+// Each scope frame adds a column of log-frequency magnitudes. Columns are
+// kept in a ring texture, and only new ones are uploaded, so the cost of
+// drawing does not depend on the length of history.
+
+class Spectrogram : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY( int server READ serverPort WRITE setServerPort )
+    Q_PROPERTY( int buffer READ bufferNumber WRITE setBufferNumber )
+    Q_PROPERTY( int channel READ channel WRITE setChannel )
+    Q_PROPERTY( int history READ history WRITE setHistory )
+    Q_PROPERTY( int bins READ bins WRITE setBins )
+    Q_PROPERTY( float range READ range WRITE setRange )
+    Q_PROPERTY( int updateInterval READ updateInterval WRITE setUpdateInterval )
+    Q_PROPERTY( bool running READ running WRITE setRunning NOTIFY runningChanged )
+
+public:
+    Spectrogram( QQuickItem * parent = 0 );
+    ~Spectrogram();
+
+    int serverPort() const { return m_server_port; }
+    void setServerPort( int );
+
+    int bufferNumber() const { return m_scope_index; }
+    void setBufferNumber( int );
+
+    int channel() const { return m_channel; }
+    void setChannel( int );
+
+    // Amount of columns shown
+    int history() const { return m_history; }
+    void setHistory( int );
+
+    // Amount of frequency bands
+    int bins() const { return m_settings.bins; }
+    void setBins( int );
+
+    // Displayed decibels below full scale
+    float range() const { return m_settings.range; }
+    void setRange( float );
+
+    int updateInterval() const { return m_timer->interval(); }
+    void setUpdateInterval( int interval ) { m_timer->setInterval( qMax(0, interval) ); }
+
+    bool running() const { return m_running; }
+    void setRunning( bool running )
+    {
+        if (running)
+            start();
+        else
+            stop();
+    }
+
+    Q_INVOKABLE void start();
+    Q_INVOKABLE void stop();
+
+signals:
+    void runningChanged( bool running );
+
+protected:
+    QSGNode * updatePaintNode( QSGNode * oldNode, UpdatePaintNodeData * );
+
+private Q_SLOTS:
+    void checkColumns();
+
+private:
+    bool connectReader();
+    void disconnectReader();
+
+    int m_server_port;
+    int m_scope_index;
+    int m_channel;
+    int m_history;
+    SpectrumSettings m_settings;
+    bool m_running;
+
+    OscilloscopeShm *m_shm;
+    ScopeReaderThread *m_reader;
+    QTimer *m_timer;
+
+    // Only used by the render thread
+    std::vector<unsigned char> m_columns;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SPECTROGRAM_INCLUDED
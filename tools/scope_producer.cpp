@@ -0,0 +1,129 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Writes synthetic signals into scope buffers and control buses of a
+// server shared memory segment, standing in for scsynth.
+//
+// Usage: scope_producer [--force-cleanup] <port> [channels] [frames] [buffers] [pushes per second]
+//
+// Scope buffers 0 to (buffers - 1) each get 'channels' channels of 'frames'
+// frames. Stop with Ctrl+C.
+//
+// With --force-cleanup, a segment left behind by a crashed server or producer
+// is removed first. Never use it on the port of a running server.
+
+#include "scope_signal_producer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <vector>
+
+using namespace QuickCollider;
+
+namespace {
+
+volatile std::sig_atomic_t g_quit = 0;
+
+void onSignal( int ) { g_quit = 1; }
+
+int argument( const std::vector<char*> & args, int index, int default_value )
+{
+    return (int) args.size() > index ? std::atoi(args[index]) : default_value;
+}
+
+} // namespace
+
+int main( int argc, char *argv[] )
+{
+    bool force_cleanup = false;
+    std::vector<char*> args;
+    for (int idx = 0; idx < argc; ++idx) {
+        if (std::strcmp(argv[idx], "--force-cleanup") == 0)
+            force_cleanup = true;
+        else
+            args.push_back(argv[idx]);
+    }
+
+    if (args.size() < 2) {
+        std::fprintf(stderr,
+                     "Usage: %s [--force-cleanup] <port> [channels] [frames] [buffers] [pushes per second]\n",
+                     argv[0]);
+        return 1;
+    }
+
+    int port = argument(args, 1, 57110);
+    int channels = argument(args, 2, 2);
+    int frames = argument(args, 3, 4096);
+    int buffers = argument(args, 4, 1);
+    int rate = argument(args, 5, 0);
+
+    if (channels < 1 || frames < 1 || buffers < 1 || rate < 0) {
+        std::fprintf(stderr, "Invalid arguments.\n");
+        return 1;
+    }
+
+    // By default, push as often as a server would at 48 kHz.
+    const float sample_rate = 48000.f;
+    if (rate == 0)
+        rate = std::max(1, (int) (sample_rate / frames));
+
+    if (force_cleanup)
+        ScopeSignalProducer::cleanup( port );
+
+    try {
+        ScopeSignalProducer producer( port, 16384, sample_rate );
+
+        for (int idx = 0; idx < buffers; ++idx) {
+            if (!producer.addScopeBuffer( idx, channels, frames )) {
+                std::fprintf(stderr, "Could not allocate scope buffer %d.\n", idx);
+                return 1;
+            }
+        }
+
+        std::signal(SIGINT, &onSignal);
+        std::signal(SIGTERM, &onSignal);
+
+        std::printf("Producing %d buffers of %d channels x %d frames, %d times per second, on port %d.\n",
+                    buffers, channels, frames, rate, port);
+
+        typedef std::chrono::steady_clock Clock;
+        const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(1.0 / rate));
+        int frames_per_push = std::max(1, (int) (sample_rate / rate));
+
+        Clock::time_point next = Clock::now();
+        while (!g_quit) {
+            producer.write( frames_per_push );
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+    }
+    catch (std::exception & e) {
+        std::fprintf(stderr, "Could not create shared memory for port %d: %s\n"
+                     "Is a server running on it? If not, a stale segment may be removed "
+                     "with --force-cleanup.\n", port, e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_SCOPE_SIGNAL_PRODUCER_INCLUDED
+#define QUICK_COLLIDER_SCOPE_SIGNAL_PRODUCER_INCLUDED
+
+// from SC source:
+#include <common/server_shm.hpp>
+
+#include <cmath>
+#include <vector>
+
+namespace QuickCollider {
+
+// Stands in for scsynth: creates the server shared memory segment for a port
+// and writes synthetic signals into scope buffers and control buses, so that
+// scopes and meters can be exercised without a running server.
+//
+// Each channel gets a sine of a different frequency, with some harmonics and
+// a little noise; control buses get slow sines of different rates.
+//
+// NOTE: This must not depend on Qt, so that it can be built into standalone tools.
+
+class ScopeSignalProducer
+{
+public:
+    // Throws if the segment can not be created, e.g. when a server is
+    // running on the port.
+    ScopeSignalProducer( int port, int control_buses, float sample_rate = 48000.f ):
+        m_port(port),
+        m_creator(port, control_buses),
+        m_control_bus_count(control_buses),
+        m_sample_rate(sample_rate),
+        m_time(0),
+        m_noise_state(22222u)
+    {}
+
+    ~ScopeSignalProducer()
+    {
+        for (size_t idx = 0; idx < m_buffers.size(); ++idx)
+            m_creator.release_scope_buffer_writer( m_buffers[idx].writer );
+        server_shared_memory_creator::cleanup( m_port );
+    }
+
+    // Removes a segment left behind by a crashed server or producer.
+    static void cleanup( int port ) { server_shared_memory_creator::cleanup( port ); }
+
+    // Allocates scope buffer 'index' to be written by write().
+    bool addScopeBuffer( int index, int channels, int frames )
+    {
+        Buffer buffer;
+        buffer.writer = m_creator.get_scope_buffer_writer( index, channels, frames );
+        if (!buffer.writer.valid())
+            return false;
+        buffer.channels = channels;
+        buffer.frames = frames;
+        m_buffers.push_back( buffer );
+        return true;
+    }
+
+    // Writes and pushes the next 'frames' of signal into every scope buffer,
+    // and updates the control buses. 'frames' is clipped to each buffer's size.
+    void write( int frames )
+    {
+        const float two_pi = 6.2831853f;
+
+        for (size_t idx = 0; idx < m_buffers.size(); ++idx)
+        {
+            Buffer & buffer = m_buffers[idx];
+            int count = frames < buffer.frames ? frames : buffer.frames;
+            float *data = buffer.writer.data();
+            for (int ch = 0; ch < buffer.channels; ++ch)
+            {
+                float *out = data + ch * buffer.frames;
+                double freq = 110.0 * (ch + 1);
+                for (int i = 0; i < count; ++i) {
+                    float phase = (float) std::fmod((m_time + i) * freq / m_sample_rate, 1.0) * two_pi;
+                    out[i] = 0.6f * std::sin(phase) + 0.2f * std::sin(3.f * phase)
+                            + 0.05f * noise();
+                }
+            }
+            buffer.writer.push( count );
+        }
+
+        float *buses = m_creator.get_control_busses();
+        double seconds = m_time / m_sample_rate;
+        for (int bus = 0; bus < m_control_bus_count; ++bus)
+            buses[bus] = 0.5f + 0.5f * (float) std::sin(seconds * (0.25 + (bus % 16) * 0.125) * two_pi);
+
+        m_time += frames;
+    }
+
+    float sampleRate() const { return m_sample_rate; }
+
+private:
+    struct Buffer
+    {
+        scope_buffer_writer writer;
+        int channels;
+        int frames;
+    };
+
+    float noise()
+    {
+        // Linear congruential; good enough and the same on every platform.
+        m_noise_state = m_noise_state * 1664525u + 1013904223u;
+        return (m_noise_state >> 8) * (2.f / 16777216.f) - 1.f;
+    }
+
+    int m_port;
+    server_shared_memory_creator m_creator;
+    int m_control_bus_count;
+    float m_sample_rate;
+    long long m_time;
+    unsigned int m_noise_state;
+    std::vector<Buffer> m_buffers;
+};
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_SCOPE_SIGNAL_PRODUCER_INCLUDED
@@ -0,0 +1,79 @@
+/*
+  QuickCollider - Qt Quick based GUI for SuperCollider
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICK_COLLIDER_CPU_FEATURES_INCLUDED
+#define QUICK_COLLIDER_CPU_FEATURES_INCLUDED
+
+// SIMD kernels are compiled with per-function target attributes and
+// selected at runtime, so the build does not depend on -msse/-mavx flags.
+// Only GCC and Clang on x86 are supported; everything else uses scalar code.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define QC_SIMD_X86 1
+#define QC_TARGET_SSE2 __attribute__((target("sse2")))
+#define QC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define QC_SIMD_X86 0
+#endif
+
+namespace QuickCollider {
+
+enum InstructionSet {
+    ScalarInstructions,
+    Sse2Instructions,
+    Avx2Instructions
+};
+
+inline bool cpuSupports( InstructionSet isa )
+{
+    switch (isa)
+    {
+    case ScalarInstructions:
+        return true;
+#if QC_SIMD_X86
+    case Sse2Instructions:
+        return __builtin_cpu_supports("sse2");
+    case Avx2Instructions:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+inline InstructionSet bestInstructionSet()
+{
+    if (cpuSupports(Avx2Instructions))
+        return Avx2Instructions;
+    if (cpuSupports(Sse2Instructions))
+        return Sse2Instructions;
+    return ScalarInstructions;
+}
+
+inline const char * instructionSetName( InstructionSet isa )
+{
+    switch (isa)
+    {
+    case Sse2Instructions: return "sse2";
+    case Avx2Instructions: return "avx2";
+    default: return "scalar";
+    }
+}
+
+} // namespace QuickCollider
+
+#endif // QUICK_COLLIDER_CPU_FEATURES_INCLUDED